@@ -0,0 +1,319 @@
+/**
+ * sjtu::map against std::map on the same workloads and keys.
+ *
+ *   g++ -std=c++17 -O2 -DNDEBUG -Isrc bench/map_bench.cpp -o map_bench
+ *   ./map_bench [--sizes 1000,10000,100000,1000000] [--keys int,Integer,string,Bint]
+ *               [--workloads insert_random,find_hit,...] [--bint-max 10000] [--label <commit>]
+ *
+ * every measurement is one JSON object on its own line:
+ *   {"label": ..., "impl": "sjtu" | "std", "key": ..., "workload": ..., "n": ...,
+ *    "ops": ..., "ns_per_op": ..., "mops_per_s": ..., "bytes_per_elem": ..., "peak_rss_kb": ...}
+ * ops counts the element operations timed, over all repetitions; small sizes
+ * are repeated until minOps operations or minNs of timed work have run. bytes_per_elem is the
+ * heap a map of n elements holds divided by n, keys and values included, as
+ * counted by the global operator new below. peak_rss_kb is the peak of the
+ * whole process so far, so it only grows along a run.
+ *
+ * Bint keys are a few KiB each, so sizes above --bint-max skip them; sizes
+ * below 2 are skipped altogether.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "map.hpp"
+#include "../data/class-bint.hpp"
+
+// heap bytes in use; every allocation carries its size in front of it.
+// gcc pairs the free() below with the operator new it sees inlined and warns
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static size_t heapLive = 0;
+
+void *operator new(size_t sz) {
+  void *p = std::malloc(sz + alignof(std::max_align_t));
+  if (!p) throw std::bad_alloc();
+  *static_cast<size_t *>(p) = sz;
+  heapLive += sz;
+  return static_cast<char *>(p) + alignof(std::max_align_t);
+}
+void operator delete(void *p) noexcept {
+  if (!p) return;
+  char *block = static_cast<char *>(p) - alignof(std::max_align_t);
+  heapLive -= *reinterpret_cast<size_t *>(block);
+  std::free(block);
+}
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+namespace {
+
+// the Integer of the data tests: it counts its live objects, so copies are
+// not trivial and it is passed by reference; no operator<, ordered by a
+// separate functor
+struct Integer {
+  static long counter;
+  int val;
+  Integer(int val) : val(val) { ++counter; }
+  Integer(const Integer &rhs) : val(rhs.val) { ++counter; }
+  Integer &operator=(const Integer &rhs) {
+    val = rhs.val;
+    return *this;
+  }
+  ~Integer() { --counter; }
+};
+long Integer::counter = 0;
+struct IntegerLess {
+  bool operator()(const Integer &lhs, const Integer &rhs) const { return lhs.val < rhs.val; }
+};
+
+template<class K> struct key_traits;
+template<> struct key_traits<int> {
+  typedef std::less<int> compare;
+  static const char *name() { return "int"; }
+  static int make(int x) { return x; }
+};
+template<> struct key_traits<Integer> {
+  typedef IntegerLess compare;
+  static const char *name() { return "Integer"; }
+  static Integer make(int x) { return Integer(x); }
+};
+template<> struct key_traits<std::string> {
+  typedef std::less<std::string> compare;
+  static const char *name() { return "string"; }
+  // long enough to leave the small-string buffer, like real keys
+  static std::string make(int x) { return "key-" + std::to_string(x) + "-0123456789abcdef"; }
+};
+template<> struct key_traits<Util::Bint> {
+  typedef std::less<Util::Bint> compare;
+  static const char *name() { return "Bint"; }
+  static Util::Bint make(int x) { return Util::Bint((long long)x * 1000003); }
+};
+
+const size_t minOps = 2000000;
+const double minNs = 2e8;
+volatile long sink;
+
+struct options {
+  std::vector<size_t> sizes;
+  std::vector<std::string> keys, workloads;
+  size_t bintMax = 10000;
+  std::string label;
+};
+
+bool wanted(const std::vector<std::string> &list, const char *name) {
+  return list.empty() || std::find(list.begin(), list.end(), name) != list.end();
+}
+
+long peakRssKb() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+#if defined(__APPLE__)
+  return ru.ru_maxrss / 1024;
+#else
+  return ru.ru_maxrss;
+#endif
+}
+
+// the keys of one run: present in random and sorted order, and as many absent ones
+template<class K>
+struct key_set {
+  std::vector<K> shuffled, sorted, missing;
+  key_set(size_t n) {
+    std::vector<int> ids(n);
+    for (size_t i = 0; i < n; ++i) ids[i] = int(2 * i);
+    std::mt19937 rng(20240611);
+    std::shuffle(ids.begin(), ids.end(), rng);
+    shuffled.reserve(n);
+    missing.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      shuffled.push_back(key_traits<K>::make(ids[i]));
+      missing.push_back(key_traits<K>::make(ids[i] + 1));
+    }
+    sorted = shuffled;
+    std::sort(sorted.begin(), sorted.end(), typename key_traits<K>::compare());
+  }
+};
+
+template<class Map, class K>
+void fill(Map &m, const std::vector<K> &keys) {
+  for (size_t i = 0; i < keys.size(); ++i) m.insert(typename Map::value_type(keys[i], int(i)));
+}
+
+// reads [lo, hi): scan() for sjtu::map, lower_bound plus ++ for std::map
+template<class K, class C, class A, class P, class Visit>
+size_t scanRange(sjtu::map<K, int, C, A, P> &m, const K &lo, const K &hi, Visit visit) { return m.scan(lo, hi, visit); }
+template<class K, class C, class Visit>
+size_t scanRange(std::map<K, int, C> &m, const K &lo, const K &hi, Visit visit) {
+  size_t cnt = 0;
+  for (auto it = m.lower_bound(lo); it != m.end() && m.key_comp()(it->first, hi); ++it, ++cnt) visit(*it);
+  return cnt;
+}
+
+// runs setup(); op() until minOps element operations or minNs have been timed, and
+// prints the record. op returns how many operations it performed.
+template<class Setup, class Op>
+void measure(const options &opt, const char *impl, const char *key, const char *workload, size_t n,
+             double bytesPerElem, Setup setup, Op op) {
+  if (!wanted(opt.workloads, workload)) return;
+  size_t ops = 0;
+  double ns = 0;
+  do {
+    setup();
+    auto t0 = std::chrono::steady_clock::now();
+    ops += op();
+    auto t1 = std::chrono::steady_clock::now();
+    ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+  } while (ops && ops < minOps && ns < minNs);
+  printf("{\"label\": \"%s\", \"impl\": \"%s\", \"key\": \"%s\", \"workload\": \"%s\", \"n\": %zu, "
+         "\"ops\": %zu, \"ns_per_op\": %.2f, \"mops_per_s\": %.3f, \"bytes_per_elem\": %.1f, \"peak_rss_kb\": %ld}\n",
+         opt.label.c_str(), impl, key, workload, n, ops, ops ? ns / ops : 0.0, ns > 0 ? ops / ns * 1e3 : 0.0,
+         bytesPerElem, peakRssKb());
+  fflush(stdout);
+}
+
+template<class Map, class K>
+void runMap(const options &opt, const char *impl, const key_set<K> &ks) {
+  const char *key = key_traits<K>::name();
+  size_t n = ks.shuffled.size();
+  double bytes;
+  {
+    size_t before = heapLive;
+    Map m;
+    fill(m, ks.shuffled);
+    bytes = double(heapLive - before) / n;
+  }
+  Map m, other;
+  auto none = [] {};
+  auto empty = [&] { m.clear(); };
+  auto full = [&] { if (m.size() != n) { m.clear(); fill(m, ks.shuffled); } };
+
+  measure(opt, impl, key, "insert_random", n, bytes, empty, [&] { fill(m, ks.shuffled); return n; });
+  measure(opt, impl, key, "insert_sequential", n, bytes, empty, [&] { fill(m, ks.sorted); return n; });
+  measure(opt, impl, key, "insert_reverse", n, bytes, empty, [&] {
+    for (size_t i = n; i--;) m.insert(typename Map::value_type(ks.sorted[i], int(i)));
+    return n;
+  });
+  // every key once as an insert, then once as an update
+  measure(opt, impl, key, "upsert", n, bytes, empty, [&] {
+    for (int round = 0; round < 2; ++round)
+      for (size_t i = 0; i < n; ++i) m[ks.shuffled[i]] += 1;
+    return 2 * n;
+  });
+  measure(opt, impl, key, "find_hit", n, bytes, full, [&] {
+    long s = 0;
+    for (size_t i = 0; i < n; ++i) s += m.find(ks.shuffled[i])->second;
+    sink = s;
+    return n;
+  });
+  measure(opt, impl, key, "find_miss", n, bytes, full, [&] {
+    long s = 0;
+    for (size_t i = 0; i < n; ++i) s += m.find(ks.missing[i]) == m.end();
+    sink = s;
+    return n;
+  });
+  measure(opt, impl, key, "iterate_forward", n, bytes, full, [&] {
+    long s = 0;
+    for (auto it = m.begin(); it != m.end(); ++it) s += it->second;
+    sink = s;
+    return n;
+  });
+  measure(opt, impl, key, "iterate_reverse", n, bytes, full, [&] {
+    long s = 0;
+    auto it = m.end();
+    for (size_t i = 0; i < n; ++i) s += (--it)->second;
+    sink = s;
+    return n;
+  });
+  // runs of 10000 elements (n - 1 for smaller maps) from starts spread over the map
+  measure(opt, impl, key, "scan_range", n, bytes, full, [&] {
+    size_t len = std::min<size_t>(n - 1, 10000), cnt = 0;
+    long s = 0;
+    for (size_t r = 0; r < 16; ++r) {
+      size_t i = r * 2654435761u % (n - len);
+      cnt += scanRange(m, ks.sorted[i], ks.sorted[i + len], [&](const typename Map::value_type &v) { s += v.second; });
+    }
+    sink = s;
+    return cnt;
+  });
+  // the pattern of corner_data/3.cpp: erase forward through the upper half,
+  // re-checking against ++ -- end() on every step
+  measure(opt, impl, key, "erase_iterating", n, bytes, full, [&] {
+    auto x = m.find(ks.sorted[n / 2]);
+    size_t cnt = 0;
+    while (x != ++ --m.end()) { m.erase(x++); ++cnt; }
+    return cnt;
+  });
+  m.clear();
+  fill(m, ks.shuffled);
+  measure(opt, impl, key, "copy", n, bytes, none, [&] {
+    Map c(m);
+    sink = long(c.size());
+    return n;
+  });
+  measure(opt, impl, key, "assign", n, bytes, [&] { if (other.size() != n) fill(other, ks.missing); }, [&] {
+    other = m;
+    return n;
+  });
+  measure(opt, impl, key, "clear", n, bytes, full, [&] { m.clear(); return n; });
+}
+
+template<class K>
+void runKey(const options &opt, size_t n) {
+  if (!wanted(opt.keys, key_traits<K>::name())) return;
+  typedef typename key_traits<K>::compare Compare;
+  key_set<K> ks(n);
+  runMap<sjtu::map<K, int, Compare> >(opt, "sjtu", ks);
+  runMap<std::map<K, int, Compare> >(opt, "std", ks);
+}
+
+std::vector<std::string> splitList(const char *s) {
+  std::vector<std::string> res;
+  for (const char *p = s;; ++p) {
+    const char *q = std::strchr(p, ',');
+    res.push_back(q ? std::string(p, q) : std::string(p));
+    if (!q) break;
+    p = q;
+  }
+  return res;
+}
+
+}
+
+int main(int argc, char **argv) {
+  options opt;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!std::strcmp(argv[i], "--sizes")) {
+      std::vector<std::string> list = splitList(argv[i + 1]);
+      for (size_t j = 0; j < list.size(); ++j) opt.sizes.push_back(std::strtoull(list[j].c_str(), nullptr, 10));
+    } else if (!std::strcmp(argv[i], "--keys")) {
+      opt.keys = splitList(argv[i + 1]);
+    } else if (!std::strcmp(argv[i], "--workloads")) {
+      opt.workloads = splitList(argv[i + 1]);
+    } else if (!std::strcmp(argv[i], "--bint-max")) {
+      opt.bintMax = std::strtoull(argv[i + 1], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--label")) {
+      opt.label = argv[i + 1];
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (opt.sizes.empty()) opt.sizes = {1000, 10000, 100000, 1000000};
+  for (size_t i = 0; i < opt.sizes.size(); ++i) {
+    size_t n = opt.sizes[i];
+    if (n < 2) continue;  // erase_iterating keeps the lower half
+    runKey<int>(opt, n);
+    runKey<Integer>(opt, n);
+    runKey<std::string>(opt, n);
+    if (n <= opt.bintMax) runKey<Util::Bint>(opt, n);
+  }
+  return 0;
+}
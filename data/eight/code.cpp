@@ -0,0 +1,65 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+
+typedef sjtu::pool_allocator<sjtu::pair<const int, int> > Alloc;
+typedef sjtu::map<int, int, std::less<int>, Alloc, sjtu::threaded_nodes> Map;
+
+//	both directions, against the reference
+bool same(const Map &map, const std::map<int, int> &ref) {
+	if (map.size() != ref.size()) return false;
+	Map::const_iterator it = map.cbegin();
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++it)
+		if (it == map.cend() || it->first != jt->first || it->second != jt->second) return false;
+	if (it != map.cend()) return false;
+	for (std::map<int, int>::const_reverse_iterator jt = ref.rbegin(); jt != ref.rend(); ++jt)
+		if ((--it)->first != jt->first) return false;
+	return it == map.cbegin();
+}
+
+int main() {
+	Map map;
+	std::map<int, int> ref;
+	long long seed = 3;
+	bool ok = true;
+	for (int step = 0; step < 200000; ++step) {
+		seed = (seed * 1103515245 + 12345) % 2147483648LL;
+		int key = (seed >> 8) % 3000;
+		switch (seed % 5) {
+			case 0: case 1: map[key] = step; ref[key] = step; break;
+			case 2: map.insert(sjtu::pair<int, int>(key, step)); ref.insert(std::make_pair(key, step)); break;
+			default: {
+				Map::iterator it = map.find(key);
+				if (it != map.end()) { map.erase(it); ref.erase(key); }
+			}
+		}
+		if (step % 20000 == 0) ok = ok && same(map, ref);
+	}
+	std::cout << map.size() << " " << ok << " " << same(map, ref) << std::endl;
+
+	//	erase while walking, with the links of the neighbours kept up
+	for (Map::iterator it = map.begin(); it != map.end();) {
+		Map::iterator next = it;
+		++next;
+		if (it->first % 3 == 0) { ref.erase(it->first); map.erase(it); }
+		it = next;
+	}
+	Map copy(map);
+	copy[-1] = -1;
+	Map assigned;
+	assigned = copy;
+	assigned.erase(assigned.find(-1));
+	std::cout << map.size() << " " << same(map, ref) << " " << same(assigned, ref) << " " << copy.begin()->first << std::endl;
+
+	//	ascending inserts and the ends
+	std::map<int, int> sorted;
+	Map built;
+	for (int i = 0; i < 1000; ++i) sorted[i] = built[i] = i;
+	std::cout << same(built, sorted) << " " << (--built.end())->first << " " << built.begin()->first << std::endl;
+	try {
+		--built.begin();
+	} catch (const sjtu::invalid_iterator &) {
+		std::cout << "invalid_iterator" << std::endl;
+	}
+	return 0;
+}
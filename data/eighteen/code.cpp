@@ -0,0 +1,100 @@
+#include "persistent_map.hpp"
+#include <iostream>
+#include <cassert>
+#include <map>
+#include <memory>
+
+//	copying throws once armed, after the given number of copies
+struct Value {
+	static int countdown;
+	static int alive;
+	int val;
+	Value(int val = 0) : val(val) { ++alive; }
+	Value(const Value &rhs) : val(rhs.val) {
+		if (countdown >= 0 && countdown-- == 0) throw 1;
+		++alive;
+	}
+	Value &operator=(const Value &rhs) { val = rhs.val; return *this; }
+	~Value() { --alive; }
+};
+int Value::countdown = -1;
+int Value::alive = 0;
+
+template<class Map>
+long long sum(const Map &map) {
+	long long s = 0;
+	size_t cnt = 0;
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it, ++cnt) s += it->second.val;
+	assert(cnt == map.size());
+	return s;
+}
+
+template<class Map>
+bool same(const Map &map, const std::map<int, int> &ref) {
+	if (map.size() != ref.size()) return false;
+	typename Map::const_iterator it = map.cbegin();
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++it)
+		if (it->first != jt->first || it->second.val != jt->second) return false;
+	return it == map.cend();
+}
+
+//	a copy that hits a throw in every write it tries must leave both versions intact
+template<class Map>
+void test_throwing_writes(const char *name) {
+	Map map;
+	std::map<int, int> ref;
+	for (int i = 0; i < 100; ++i) { map.insert(typename Map::value_type(i, Value(i))); ref[i] = i; }
+	int thrown = 0;
+	for (int k = 0; k < 40; ++k) {
+		Map copy(map);
+		std::map<int, int> mine(ref);
+		for (int step = 0; step < 3; ++step) {
+			int key = step == 0 ? 1000 + k : (k * (step == 1 ? 37 : 53)) % 100;
+			Value::countdown = k % 7;
+			try {
+				if (step == 0) { copy.insert(typename Map::value_type(key, Value(k))); mine[key] = k; }
+				else if (step == 1) { copy.erase(key); mine.erase(key); }
+				else { copy[key].val = -1; mine[key] = -1; }
+			} catch (int) {
+				++thrown;
+			}
+			Value::countdown = -1;
+		}
+		assert(same(copy, mine));
+	}
+	std::cout << name << " " << thrown << " " << sum(map) << " " << same(map, ref) << std::endl;
+}
+
+//	copies keep their contents whatever is done to the others
+void test_versions() {
+	typedef sjtu::persistent_map<int, Value> Map;
+	std::map<int, int> ref[8];
+	Map version[8];
+	long long seed = 1;
+	for (int step = 0; step < 20000; ++step) {
+		seed = (seed * 1103515245 + 12345) % 2147483648LL;
+		int v = seed % 8, key = (seed >> 8) % 500;
+		if (step % 97 == 0) {
+			int from = (seed >> 20) % 8;
+			version[v] = version[from];
+			ref[v] = ref[from];
+		} else if (seed & 16) {
+			version[v].erase(key);
+			ref[v].erase(key);
+		} else {
+			version[v].insert_or_assign(key, Value(step));
+			ref[v][key] = step;
+		}
+	}
+	int ok = 0;
+	for (int v = 0; v < 8; ++v) ok += same(version[v], ref[v]);
+	std::cout << "versions " << ok << std::endl;
+}
+
+int main() {
+	test_throwing_writes<sjtu::persistent_map<int, Value> >("pool");
+	test_throwing_writes<sjtu::persistent_map<int, Value, std::less<int>, std::allocator<sjtu::pair<const int, Value> > > >("heap");
+	test_versions();
+	std::cout << Value::alive << std::endl;
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include "btree_map.hpp"
+#include <iostream>
+#include <cassert>
+#include <map>
+
+//	copying throws once armed, after the given number of copies
+class Key {
+public:
+	static int countdown;
+	static int alive;
+	int x;
+	Key(int x) : x(x) { ++alive; }
+	Key(const Key &rhs) : x(rhs.x) {
+		if (countdown >= 0 && countdown-- == 0) throw 1;
+		++alive;
+	}
+	Key(Key &&rhs) noexcept : x(rhs.x) { ++alive; }
+	~Key() { --alive; }
+	bool operator<(const Key &rhs) const { return x < rhs.x; }
+};
+int Key::countdown = -1;
+int Key::alive = 0;
+
+typedef sjtu::btree_map<Key, int> Map;
+typedef sjtu::pair<const Key, int> Value;
+
+bool same(const Map &map, const std::map<int, int> &ref) {
+	if (map.size() != ref.size()) return false;
+	Map::const_iterator it = map.cbegin();
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++it)
+		if (it == map.cend() || it->first.x != jt->first || it->second != jt->second) return false;
+	if (it != map.cend()) return false;
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt)
+		if (map.count(Key(jt->first)) != 1) return false;
+	return true;
+}
+
+//	inserts that throw while copying a key, splits included, must change nothing
+void test_throwing_key() {
+	Map map;
+	std::map<int, int> ref;
+	int thrown = 0;
+	long long seed = 7;
+	for (int step = 0; step < 30000; ++step) {
+		seed = (seed * 1103515245 + 12345) % 2147483648LL;
+		int key = step % 3 == 0 ? step : (seed >> 8) % 20000;
+		Key k(key);
+		Value v(k, step);
+		Key::countdown = (seed >> 4) % 4;
+		try {
+			switch (step % 4) {
+				case 0: map.insert(v); break;
+				case 1: map.insert_or_assign(k, step); break;
+				case 2: map.emplace(k, step); break;
+				default: map.try_emplace(k, step); break;
+			}
+			Key::countdown = -1;
+			if (step % 4 == 1) ref[key] = step;
+			else ref.insert(std::make_pair(key, step));
+		} catch (int) {
+			Key::countdown = -1;
+			++thrown;
+		}
+		if (step % 5 == 4) {
+			int gone = (seed >> 12) % 20000;
+			map.erase(Key(gone));
+			ref.erase(gone);
+		}
+	}
+	std::cout << (thrown > 0) << " " << same(map, ref) << std::endl;
+	map.clear();
+	std::cout << map.size() << " " << Key::alive << std::endl;
+}
+
+//	sorted appends fill leaves; a throw on the append that splits must not lose one
+void test_append() {
+	Map map;
+	int thrown = 0;
+	for (int i = 0; i < 5000; ++i) {
+		Value v(Key(i), i);
+		Key::countdown = i % 3;
+		try {
+			map.insert(v);
+		} catch (int) {
+			++thrown;
+		}
+		Key::countdown = -1;
+		map.insert(v);
+	}
+	long long s = 0;
+	int last = -1;
+	bool ordered = true;
+	for (Map::const_iterator it = map.cbegin(); it != map.cend(); ++it) {
+		ordered = ordered && last < it->first.x;
+		last = it->first.x;
+		s += it->second;
+	}
+	std::cout << (thrown > 0) << " " << map.size() << " " << s << " " << ordered << std::endl;
+}
+
+int main() {
+	test_throwing_key();
+	test_append();
+	std::cout << Key::alive << std::endl;
+	return 0;
+}
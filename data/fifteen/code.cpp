@@ -0,0 +1,57 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+#include <iterator>
+
+typedef sjtu::map<int, long> Map;
+
+//	find_batch and count_batch against one lookup at a time in std::map
+int main() {
+	Map map;
+	std::map<int, long> ref;
+	std::srand(17);
+	for (int i = 0; i < 50000; ++i) {
+		int k = std::rand() % 100000;
+		map[k] = i;
+		ref[k] = i;
+	}
+	bool ok = true;
+	long sum = 0;
+	for (int round = 0; round < 50; ++round) {
+		//	batches of every length, up to well past the interleaving width
+		std::vector<int> keys(round * 7);
+		for (size_t i = 0; i < keys.size(); ++i) keys[i] = std::rand() % 100010 - 5;
+		std::vector<Map::iterator> found(1, map.end());
+		map.find_batch(keys.begin(), keys.end(), std::back_inserter(found));
+		ok = ok && found.size() == keys.size() + 1;
+		std::vector<size_t> counts(keys.size() + 3, 7);
+		std::vector<size_t>::iterator stop = static_cast<const Map &>(map).count_batch(keys.begin(), keys.end(), counts.begin());
+		ok = ok && stop == counts.begin() + keys.size() && counts[keys.size()] == 7;
+		std::vector<Map::const_iterator> cfound(keys.size());
+		static_cast<const Map &>(map).find_batch(keys.begin(), keys.end(), cfound.begin());
+		for (size_t i = 0; i < keys.size(); ++i) {
+			std::map<int, long>::iterator r = ref.find(keys[i]);
+			Map::iterator f = found[i + 1];
+			if (r == ref.end()) {
+				ok = ok && f == map.end() && cfound[i] == map.cend() && counts[i] == 0;
+			} else {
+				ok = ok && f != map.end() && f->first == r->first && f->second == r->second;
+				ok = ok && cfound[i]->first == r->first && counts[i] == 1;
+				//	the iterators are usable to write through
+				f->second += 1;
+				++r->second;
+				sum += f->second;
+			}
+		}
+		//	and the map changed in between still agrees
+		for (int i = 0; i < 200; ++i) {
+			int k = std::rand() % 100000;
+			if (ref.erase(k)) map.erase(map.find(k));
+			else map[k] = ref[k] = i;
+		}
+	}
+	std::cout << ok << " " << sum << std::endl;
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+//	orders strings, and compares them with plain C strings without building one
+struct StrLess {
+	typedef void is_transparent;
+	bool operator()(const std::string &a, const std::string &b) const { return a < b; }
+	bool operator()(const std::string &a, const char *b) const { return std::strcmp(a.c_str(), b) < 0; }
+	bool operator()(const char *a, const std::string &b) const { return std::strcmp(a, b.c_str()) < 0; }
+};
+
+//	a key known by its id alone
+struct Account {
+	int id;
+	std::string owner;
+};
+struct ById {
+	typedef void is_transparent;
+	bool operator()(const Account &a, const Account &b) const { return a.id < b.id; }
+	bool operator()(const Account &a, int b) const { return a.id < b; }
+	bool operator()(int a, const Account &b) const { return a < b.id; }
+};
+
+std::string name(int i) {
+	char buf[16];
+	std::sprintf(buf, "k%05d", i);
+	return buf;
+}
+
+//	every transparent lookup, with a probe of another type, against std::map
+void test_strings() {
+	sjtu::map<std::string, int, StrLess> map;
+	std::map<std::string, int, StrLess> ref;
+	for (int i = 0; i < 20000; i += 2) { map[name(i)] = i; ref[name(i)] = i; }
+	bool ok = true;
+	for (int i = -1; i <= 20001; ++i) {
+		std::string s = name(i);
+		const char *k = s.c_str();
+		const sjtu::map<std::string, int, StrLess> &c = map;
+		ok = ok && map.count(k) == ref.count(k);
+		ok = ok && (map.find(k) == map.end()) == (ref.find(k) == ref.end());
+		ok = ok && (c.find(k) == c.cend()) == (ref.find(k) == ref.end());
+		if (ref.count(k)) ok = ok && map.at(k) == ref.at(k) && c.at(k) == i && map.find(k)->first == s;
+		std::map<std::string, int, StrLess>::iterator lb = ref.lower_bound(k), ub = ref.upper_bound(k);
+		ok = ok && (lb == ref.end() ? map.lower_bound(k) == map.end() : map.lower_bound(k)->first == lb->first);
+		ok = ok && (ub == ref.end() ? c.upper_bound(k) == c.cend() : c.upper_bound(k)->first == ub->first);
+		sjtu::pair<sjtu::map<std::string, int, StrLess>::iterator, sjtu::map<std::string, int, StrLess>::iterator> er = map.equal_range(k);
+		ok = ok && er.first == map.lower_bound(k) && er.second == map.upper_bound(k);
+		if (i % 2 == 0 && i >= 0 && i < 20000) map.at(k) += 1;
+	}
+	//	a missing key still throws
+	try {
+		map.at("missing");
+		ok = false;
+	} catch (const sjtu::index_out_of_bound &) {}
+	std::cout << ok << " " << map.at("k00010") << " " << map.count("k00011") << std::endl;
+}
+
+void test_accounts() {
+	sjtu::map<Account, double, ById> map;
+	for (int i = 0; i < 100; ++i) {
+		Account a = {i * 10, name(i)};
+		map[a] = i * 1.5;
+	}
+	map.at(420) = 0.25;
+	sjtu::map<Account, double, ById>::iterator it = map.lower_bound(415);
+	std::cout << it->first.id << " " << it->first.owner << " " << it->second << " "
+		<< map.count(421) << " " << map.count(990) << " " << (map.upper_bound(990) == map.end()) << std::endl;
+}
+
+int main() {
+	test_strings();
+	test_accounts();
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+
+typedef sjtu::pool_allocator<sjtu::pair<const int, int> > Alloc;
+typedef sjtu::map<int, int, std::less<int>, Alloc, sjtu::sized_nodes> Map;
+
+//	rank, select and index_of at every position, and the bounds of every key in range
+bool orders(const Map &map, const std::map<int, int> &ref) {
+	if (map.size() != ref.size()) return false;
+	size_t k = 0;
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++k) {
+		Map::const_iterator it = map.select(k);
+		if (it->first != jt->first || map.index_of(it) != k || map.rank(jt->first) != k) return false;
+	}
+	if (map.index_of(map.cend()) != map.size()) return false;
+	for (int key = -1; key <= 3001; key += 7) {
+		std::map<int, int>::const_iterator lo = ref.lower_bound(key), up = ref.upper_bound(key);
+		Map::const_iterator a = map.lower_bound(key), b = map.upper_bound(key);
+		if ((a == map.cend()) != (lo == ref.end()) || (a != map.cend() && a->first != lo->first)) return false;
+		if ((b == map.cend()) != (up == ref.end()) || (b != map.cend() && b->first != up->first)) return false;
+		sjtu::pair<Map::const_iterator, Map::const_iterator> r = map.equal_range(key);
+		if (map.index_of(r.second) - map.index_of(r.first) != ref.count(key)) return false;
+	}
+	return true;
+}
+
+int main() {
+	Map map;
+	std::map<int, int> ref;
+	long long seed = 11;
+	bool ok = true;
+	for (int step = 0; step < 100000; ++step) {
+		seed = (seed * 1103515245 + 12345) % 2147483648LL;
+		int key = (seed >> 8) % 3000;
+		if (seed % 3) { map[key] = step; ref[key] = step; }
+		else { map.erase(key); ref.erase(key); }
+		if (step % 10000 == 0) ok = ok && orders(map, ref);
+	}
+	std::cout << map.size() << " " << ok << " " << orders(map, ref) << std::endl;
+
+	//	erase(first, last) keeps the sizes right
+	Map::iterator first = map.select(100), last = map.select(600);
+	map.erase(first, last);
+	std::map<int, int>::iterator a = ref.begin(), b = ref.begin();
+	for (int i = 0; i < 100; ++i) ++a;
+	for (int i = 0; i < 600; ++i) ++b;
+	ref.erase(a, b);
+	std::cout << map.size() << " " << orders(map, ref) << std::endl;
+
+	Map copy(map);
+	copy.erase(copy.select(0));
+	std::cout << copy.rank(3000) << " " << map.rank(3000) << " " << orders(map, ref) << std::endl;
+	try {
+		map.select(map.size());
+	} catch (const sjtu::index_out_of_bound &) {
+		std::cout << "index_out_of_bound" << std::endl;
+	}
+	try {
+		map.index_of(copy.cbegin());
+	} catch (const sjtu::invalid_iterator &) {
+		std::cout << "invalid_iterator" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include "parallel_map.hpp"
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <vector>
+
+typedef sjtu::pair<const int, long long> Value;
+
+template<class Map>
+void test_passes(const char *name, int n) {
+	Map map;
+	std::vector<sjtu::pair<int, long long> > v;
+	for (int i = 0; i < n; ++i) v.push_back(sjtu::pair<int, long long>(i * 3, i));
+	sjtu::parallel_assign_sorted(map, v.begin(), v.end(), 4);
+	sjtu::parallel_for_each(map, [](Value &e) { e.second *= 2; }, 4);
+	long long sum = sjtu::map_reduce(map, [](const Value &e) { return e.second; }, 0LL,
+	                                 [](long long a, long long b) { return a + b; }, 4);
+	//	not commutative: the runs must be combined in key order
+	bool ordered = sjtu::map_reduce(map, [](const Value &e) { return std::vector<int>(1, e.first); }, std::vector<int>(),
+	                                [](std::vector<int> a, const std::vector<int> &b) { a.insert(a.end(), b.begin(), b.end()); return a; }, 4)
+	               .size() == map.size();
+	int last = -1;
+	size_t cnt = 0;
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it, ++cnt) {
+		ordered = ordered && last < it->first && it->second == it->first / 3 * 2;
+		last = it->first;
+	}
+	std::cout << name << " " << map.size() << " " << cnt << " " << sum << " " << ordered << std::endl;
+}
+
+void test_order() {
+	sjtu::map<int, int> map;
+	for (int i = 0; i < 5000; ++i) map[(i * 7919) % 5000] = i;
+	std::vector<int> keys = sjtu::map_reduce(map, [](const sjtu::pair<const int, int> &e) { return std::vector<int>(1, e.first); },
+	                                         std::vector<int>(),
+	                                         [](std::vector<int> a, const std::vector<int> &b) { a.insert(a.end(), b.begin(), b.end()); return a; }, 4);
+	bool ok = keys.size() == 5000;
+	for (size_t i = 0; ok && i < keys.size(); ++i) ok = keys[i] == int(i);
+	std::cout << "order " << ok << std::endl;
+}
+
+void test_throw() {
+	sjtu::map<int, int> map;
+	for (int i = 0; i < 10000; ++i) map[i] = i;
+	int caught = 0;
+	try {
+		sjtu::parallel_for_each(map, [](sjtu::pair<const int, int> &e) { if (e.first == 4321) throw 7; }, 4);
+	} catch (int x) {
+		caught = x;
+	}
+	std::cout << "throw " << caught << " " << map.size() << std::endl;
+}
+
+int main() {
+	test_passes<sjtu::map<int, long long> >("plain", 100000);
+	test_passes<sjtu::map<int, long long, std::less<int>, sjtu::pool_allocator<Value>, sjtu::sized_nodes> >("sized", 100000);
+	test_passes<sjtu::map<int, long long> >("small", 3);
+	test_passes<sjtu::map<int, long long> >("empty", 0);
+	test_order();
+	test_throw();
+	return 0;
+}
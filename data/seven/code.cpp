@@ -0,0 +1,69 @@
+#include "map.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+
+//	counts copies and moves
+class Tracked {
+public:
+	static int copies, moves;
+	std::string s;
+	Tracked(const std::string &s) : s(s) {}
+	Tracked(const Tracked &rhs) : s(rhs.s) { ++copies; }
+	Tracked(Tracked &&rhs) : s(std::move(rhs.s)) { ++moves; }
+	Tracked &operator=(const Tracked &rhs) { s = rhs.s; ++copies; return *this; }
+	Tracked &operator=(Tracked &&rhs) { s = std::move(rhs.s); ++moves; return *this; }
+};
+int Tracked::copies = 0;
+int Tracked::moves = 0;
+
+void reset() { Tracked::copies = Tracked::moves = 0; }
+void report(const char *what) {
+	std::cout << what << " " << Tracked::copies << " " << (Tracked::moves > 0) << std::endl;
+	reset();
+}
+
+void test_counts() {
+	typedef sjtu::map<int, Tracked> Map;
+	Map map;
+	reset();
+	map.insert(Map::value_type(1, Tracked("one")));
+	report("insert");
+	map.emplace(2, Tracked("two"));
+	report("emplace");
+	sjtu::pair<int, Tracked> p(3, Tracked("three"));
+	reset();
+	map.insert(std::move(p));
+	report("insert converted");
+	Tracked t("four");
+	map.insert_or_assign(4, std::move(t));
+	report("insert_or_assign new");
+	Tracked u("FOUR");
+	map.insert_or_assign(4, std::move(u));
+	report("insert_or_assign old");
+	//	a rejected move insert leaves the value where it was
+	Map::value_type dup(1, Tracked("dup"));
+	map.insert(std::move(dup));
+	std::cout << dup.second.s << " " << map.at(1).s << " " << map.at(4).s << " " << map.size() << std::endl;
+	reset();
+}
+
+void test_move_only() {
+	sjtu::map<int, std::unique_ptr<int> > map;
+	for (int i = 0; i < 100; ++i) map.emplace(i, std::unique_ptr<int>(new int(i * i)));
+	map.insert(sjtu::pair<const int, std::unique_ptr<int> >(100, std::unique_ptr<int>(new int(-1))));
+	std::unique_ptr<int> kept(new int(7));
+	map.insert(sjtu::pair<const int, std::unique_ptr<int> >(5, std::move(kept)));
+	long long sum = 0;
+	for (sjtu::map<int, std::unique_ptr<int> >::iterator it = map.begin(); it != map.end(); ++it) sum += *it->second;
+	std::cout << map.size() << " " << sum << " " << *map.at(5) << std::endl;
+	map.erase(map.find(50));
+	map.clear();
+	std::cout << map.size() << std::endl;
+}
+
+int main() {
+	test_counts();
+	test_move_only();
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include "concurrent_map.hpp"
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+typedef sjtu::concurrent_map<int, int> Map;
+
+//	a snapshot is in key order, holds only values the writers could have
+//	stored, and does not change while it is walked
+bool consistent(const Map &map) {
+	Map::snapshot s = map.snap();
+	size_t cnt = 0, again = 0;
+	int last = -1;
+	bool ok = true;
+	for (Map::snapshot::const_iterator it = s.cbegin(); it != s.cend(); ++it, ++cnt) {
+		ok = ok && last < it->first && it->second % 1000 == it->first % 1000;
+		last = it->first;
+	}
+	for (Map::snapshot::const_iterator it = s.cbegin(); it != s.cend(); ++it) ++again;
+	return ok && cnt == again;
+}
+
+void test_basic() {
+	Map map;
+	std::cout << map.empty() << " " << map.insert(Map::value_type(1, 1)) << " " << map.insert(Map::value_type(1, 2)) << std::endl;
+	Map::snapshot before = map.snap();
+	std::cout << map.insert_or_assign(1, 1001) << " " << map.insert_or_assign(2, 2) << std::endl;
+	int v = 0;
+	bool found = map.find(1, v);
+	std::cout << found << " " << v << " " << before.find(1)->second << " " << before.count(2) << " " << map.count(2) << std::endl;
+	std::cout << map.erase(1) << " " << map.erase(1) << " " << map.size() << " " << before.count(1) << std::endl;
+	map.clear();
+	std::cout << map.size() << " " << map.snap().empty() << std::endl;
+}
+
+//	four writers on disjoint keys, four readers checking snapshots meanwhile
+void test_threads() {
+	Map map;
+	std::atomic<int> writing{4};
+	std::atomic<int> bad{0};
+	std::vector<std::thread> pool;
+	for (int t = 0; t < 4; ++t) {
+		pool.push_back(std::thread([&map, &writing, t] {
+			for (int i = t; i < 20000; i += 4) map.insert(Map::value_type(i, i));
+			for (int i = t; i < 20000; i += 8) map.insert_or_assign(i, i + 1000);
+			for (int i = t; i < 20000; i += 12) map.erase(i);
+			--writing;
+		}));
+	}
+	for (int t = 0; t < 4; ++t) {
+		pool.push_back(std::thread([&map, &writing, &bad] {
+			do {
+				if (!consistent(map)) ++bad;
+			} while (writing.load() > 0);
+		}));
+	}
+	for (size_t t = 0; t < pool.size(); ++t) pool[t].join();
+	Map::snapshot s = map.snap();
+	size_t cnt = 0;
+	long long sum = 0;
+	for (Map::snapshot::const_iterator it = s.cbegin(); it != s.cend(); ++it, ++cnt) sum += it->second;
+	std::cout << bad.load() << " " << map.size() << " " << cnt << " " << sum << " " << consistent(map) << std::endl;
+}
+
+int main() {
+	test_basic();
+	test_threads();
+	return 0;
+}
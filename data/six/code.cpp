@@ -0,0 +1,72 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+#include <string>
+
+//	counts how many objects were built
+class Value {
+public:
+	static int built;
+	std::string s;
+	Value() { ++built; }
+	Value(const std::string &s) : s(s) { ++built; }
+	Value(const std::string &a, const std::string &b) : s(a + b) { ++built; }
+	Value(const Value &rhs) : s(rhs.s) { ++built; }
+	Value &operator=(const Value &rhs) { s = rhs.s; return *this; }
+};
+int Value::built = 0;
+
+void test_try_emplace() {
+	sjtu::map<int, Value> map;
+	std::string arg = "first";
+	sjtu::pair<sjtu::map<int, Value>::iterator, bool> r = map.try_emplace(1, arg, std::string("+"));
+	std::cout << r.second << " " << r.first->second.s << " " << map.size() << std::endl;
+	//	a hit builds nothing and leaves the arguments alone, even rvalues
+	int before = Value::built;
+	std::string moved = "second";
+	sjtu::pair<sjtu::map<int, Value>::iterator, bool> hit = map.try_emplace(1, std::move(moved));
+	std::cout << hit.second << " " << hit.first->second.s << " " << moved << " " << Value::built - before << std::endl;
+	sjtu::pair<sjtu::map<int, Value>::iterator, bool> fresh = map.try_emplace(2);
+	std::cout << fresh.second << " [" << map.at(2).s << "] " << map.size() << std::endl;
+}
+
+void test_insert_or_assign() {
+	sjtu::map<int, std::string> map;
+	sjtu::pair<sjtu::map<int, std::string>::iterator, bool> r = map.insert_or_assign(5, std::string("a"));
+	std::cout << r.second << " " << r.first->second;
+	sjtu::pair<sjtu::map<int, std::string>::iterator, bool> again = map.insert_or_assign(5, std::string("b"));
+	std::cout << " " << again.second << " " << again.first->second << " " << map.at(5) << " " << map.size() << std::endl;
+}
+
+//	operator[], try_emplace and insert_or_assign against std::map
+void test_random() {
+	sjtu::map<int, int> map;
+	std::map<int, int> ref;
+	long long seed = 17;
+	for (int step = 0; step < 100000; ++step) {
+		seed = (seed * 1103515245 + 12345) % 2147483648LL;
+		int key = (seed >> 8) % 2000;
+		switch (seed % 4) {
+			case 0: map[key] += step; ref[key] += step; break;
+			case 1: map.try_emplace(key, step); ref.insert(std::make_pair(key, step)); break;
+			case 2: map.insert_or_assign(key, step); ref[key] = step; break;
+			default: {
+				sjtu::map<int, int>::iterator it = map.find(key);
+				if (it != map.end()) map.erase(it);
+				ref.erase(key);
+			}
+		}
+	}
+	bool ok = map.size() == ref.size();
+	sjtu::map<int, int>::const_iterator it = map.cbegin();
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++it)
+		ok = ok && it->first == jt->first && it->second == jt->second;
+	std::cout << map.size() << " " << ok << std::endl;
+}
+
+int main() {
+	test_try_emplace();
+	test_insert_or_assign();
+	test_random();
+	return 0;
+}
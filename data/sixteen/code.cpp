@@ -0,0 +1,83 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+
+typedef sjtu::map<int, int> Map;
+typedef Map::value_type Value;
+
+bool same(const Map &map, const std::map<int, int> &ref) {
+	if (map.size() != ref.size()) return false;
+	Map::const_iterator it = map.cbegin();
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++it)
+		if (it->first != jt->first || it->second != jt->second) return false;
+	return it == map.cend();
+}
+
+//	hints that are right, off by a few, far off and end(), against std::map
+void test_hints() {
+	Map map;
+	std::map<int, int> ref;
+	std::srand(18);
+	bool ok = true;
+	for (int i = 0; i < 60000; ++i) {
+		int k = std::rand() % 40000;
+		Map::const_iterator hint;
+		switch (i % 4) {
+			case 0: hint = map.lower_bound(k); break;
+			case 1: {
+				hint = map.lower_bound(k);
+				for (int d = std::rand() % 5; d-- && hint != map.cend();) ++hint;
+				break;
+			}
+			case 2: hint = map.lower_bound(std::rand() % 40000); break;
+			default: hint = map.cend();
+		}
+		Map::iterator r = i % 2 ? map.insert(hint, Value(k, i)) : map.insert(hint, static_cast<Value &&>(Value(k, i)));
+		std::map<int, int>::iterator s = ref.insert(std::pair<int, int>(k, i)).first;
+		ok = ok && r->first == s->first && r->second == s->second;
+		if (i % 5 == 0) {
+			int e = std::rand() % 40000;
+			if (ref.erase(e)) map.erase(map.find(e));
+		}
+	}
+	ok = ok && same(map, ref);
+	//	a hint from another map is refused
+	Map other;
+	try {
+		map.insert(other.cend(), Value(1, 1));
+		ok = false;
+	} catch (const sjtu::invalid_iterator &) {}
+	std::cout << ok << " " << map.size() << std::endl;
+}
+
+//	ascending, descending and shuffled runs through range insert
+void test_range() {
+	bool ok = true;
+	for (int order = 0; order < 3; ++order) {
+		std::vector<Value> in;
+		for (int i = 0; i < 20000; ++i) {
+			int k = order == 0 ? i * 2 : order == 1 ? 40000 - i * 2 : std::rand() % 30000;
+			in.push_back(Value(k, i));
+		}
+		Map map;
+		std::map<int, int> ref;
+		for (int i = 1; i < 40000; i += 7) { map[i] = -i; ref[i] = -i; }
+		map.insert(in.begin(), in.end());
+		for (size_t i = 0; i < in.size(); ++i) ref.insert(std::pair<int, int>(in[i].first, in[i].second));
+		ok = ok && same(map, ref);
+		Map fresh;
+		std::map<int, int> fref;
+		fresh.insert(in.begin(), in.end());
+		for (size_t i = 0; i < in.size(); ++i) fref.insert(std::pair<int, int>(in[i].first, in[i].second));
+		ok = ok && same(fresh, fref);
+	}
+	std::cout << ok << std::endl;
+}
+
+int main() {
+	test_hints();
+	test_range();
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+
+typedef sjtu::map<int, int> Map;
+typedef sjtu::map<int, int, std::less<int>, sjtu::pool_allocator<sjtu::pair<const int, int> >, sjtu::sized_nodes> Sized;
+
+template<class M>
+bool same(const M &map, const std::map<int, int> &ref) {
+	if (map.size() != ref.size()) return false;
+	typename M::const_iterator it = map.cbegin();
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++it)
+		if (it == map.cend() || it->first != jt->first || it->second != jt->second) return false;
+	if (it != map.cend()) return false;
+	for (std::map<int, int>::const_reverse_iterator jt = ref.rbegin(); jt != ref.rend(); ++jt)
+		if ((--it)->first != jt->first) return false;
+	return true;
+}
+
+template<class M>
+void fill(M &map, std::map<int, int> &ref, int from, int to, int step) {
+	for (int i = from; i < to; i += step) { map[i] = i; ref[i] = i; }
+}
+
+//	split at every kind of key, then join the halves back in either order
+template<class M>
+void test_split_join(const char *name) {
+	bool ok = true;
+	for (int at = -5; at <= 1005; at += 41) {
+		M map;
+		std::map<int, int> ref, lo, hi;
+		fill(map, ref, 0, 1000, 3);
+		M upper = map.split(at);
+		for (std::map<int, int>::iterator it = ref.begin(); it != ref.end(); ++it) (it->first < at ? lo : hi)[it->first] = it->second;
+		ok = ok && same(map, lo) && same(upper, hi);
+		//	both halves stay usable on their own
+		map[-1] = -1; lo[-1] = -1;
+		upper[5000] = 5; hi[5000] = 5;
+		ok = ok && same(map, lo) && same(upper, hi);
+		if (at % 2) { map.join(static_cast<M &&>(upper)); }
+		else { upper.join(static_cast<M &&>(map)); map = static_cast<M &&>(upper); }
+		lo.insert(hi.begin(), hi.end());
+		ok = ok && same(map, lo) && upper.empty();
+		upper[1] = 1;
+		ok = ok && upper.size() == 1;
+	}
+	std::cout << name << " split/join " << ok << std::endl;
+}
+
+//	joins of key-disjoint maps whose heights differ by a lot
+template<class M>
+void test_uneven(const char *name) {
+	bool ok = true;
+	for (int small = 0; small < 40; small += 7) {
+		M big, little, big2, little2;
+		std::map<int, int> ref, ref2;
+		fill(big, ref, 0, 100000, 1);
+		fill(little, ref, 200000, 200000 + small, 1);
+		big.join(static_cast<M &&>(little));
+		ok = ok && same(big, ref) && little.empty();
+		fill(big2, ref2, 0, 100000, 1);
+		fill(little2, ref2, -small, 0, 1);
+		little2.join(static_cast<M &&>(big2));
+		ok = ok && same(little2, ref2) && big2.empty();
+		//	the joined trees keep working
+		for (int i = 0; i < 100000; i += 3) { little2.erase(i); ref2.erase(i); }
+		ok = ok && same(little2, ref2);
+	}
+	M a, b;
+	std::map<int, int> ref;
+	fill(a, ref, 0, 10, 1);
+	fill(b, ref, 5, 15, 1);
+	try {
+		a.join(static_cast<M &&>(b));
+		ok = false;
+	} catch (const sjtu::runtime_error &) {
+		ok = ok && a.size() == 10 && b.size() == 10;
+	}
+	std::cout << name << " uneven " << ok << std::endl;
+}
+
+//	merge takes the keys we lack and leaves the rest in other
+template<class M>
+void test_merge(const char *name) {
+	M a, b;
+	std::map<int, int> ra, rb;
+	for (int i = 0; i < 3000; i += 2) { a[i] = i; ra[i] = i; }
+	for (int i = 0; i < 3000; i += 3) { b[i] = -i; rb[i] = -i; }
+	a.merge(b);
+	for (std::map<int, int>::iterator it = rb.begin(); it != rb.end();) {
+		if (ra.insert(*it).second) rb.erase(it++);
+		else ++it;
+	}
+	bool ok = same(a, ra) && same(b, rb);
+	M c;
+	std::map<int, int> rc;
+	fill(c, rc, 5000, 6000, 1);
+	a.merge(c);
+	ra.insert(rc.begin(), rc.end());
+	ok = ok && same(a, ra) && c.empty();
+	std::cout << name << " merge " << ok << " " << a.size() << " " << b.size() << std::endl;
+}
+
+//	a moved-from map is empty and can be used again
+void test_move() {
+	Map a;
+	std::map<int, int> ref;
+	fill(a, ref, 0, 100, 1);
+	Map b(static_cast<Map &&>(a));
+	a[7] = 7;
+	Map c;
+	c = static_cast<Map &&>(b);
+	b[8] = 8;
+	std::cout << a.size() << " " << b.size() << " " << same(c, ref) << std::endl;
+}
+
+int main() {
+	test_split_join<Map>("plain");
+	test_split_join<Sized>("sized");
+	test_uneven<Map>("plain");
+	test_uneven<Sized>("sized");
+	test_merge<Map>("plain");
+	test_merge<Sized>("sized");
+	test_move();
+	return 0;
+}
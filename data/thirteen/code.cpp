@@ -0,0 +1,55 @@
+#include "btree_map.hpp"
+#include <iostream>
+#include <map>
+
+//	every bound of every probe against std::map, with keys spread over the
+//	whole range of the type (signs and the top bit of unsigned included)
+template<class Key, size_t NodeBytes>
+void test_bounds(const char *name, Key step, Key first) {
+	sjtu::btree_map<Key, int, std::less<Key>, sjtu::pool_allocator<sjtu::pair<const Key, int> >, NodeBytes> map;
+	std::map<Key, int> ref;
+	for (int i = 0; i < 3000; ++i) {
+		Key k = first + step * Key((i * 7919) % 3000);
+		map[k] = i;
+		ref[k] = i;
+	}
+	for (int i = 0; i < 3000; i += 3) {
+		Key k = first + step * Key(i);
+		map.erase(k);
+		ref.erase(k);
+	}
+	bool ok = map.size() == ref.size();
+	for (int i = -2; i < 6002; ++i) {
+		Key k = first + step / 2 * Key(i);
+		typename std::map<Key, int>::const_iterator lo = ref.lower_bound(k), up = ref.upper_bound(k);
+		typename sjtu::btree_map<Key, int, std::less<Key>, sjtu::pool_allocator<sjtu::pair<const Key, int> >, NodeBytes>::const_iterator
+			a = map.lower_bound(k), b = map.upper_bound(k);
+		ok = ok && (a == map.cend() ? lo == ref.end() : lo != ref.end() && a->first == lo->first);
+		ok = ok && (b == map.cend() ? up == ref.end() : up != ref.end() && b->first == up->first);
+		ok = ok && map.count(k) == ref.count(k);
+	}
+	std::cout << name << " " << NodeBytes << " " << map.size() << " " << ok << std::endl;
+}
+
+void test_layout() {
+	sjtu::map<int, int, std::less<int>, sjtu::pool_allocator<sjtu::pair<const int, int> >, sjtu::btree_layout<> > map;
+	std::map<int, int> ref;
+	for (int i = 0; i < 50000; ++i) { map[(i * 7919) % 50000] = i; ref[(i * 7919) % 50000] = i; }
+	for (int i = 0; i < 50000; i += 5) { map.erase(i); ref.erase(i); }
+	bool ok = map.size() == ref.size();
+	std::map<int, int>::const_iterator jt = ref.begin();
+	for (auto it = map.cbegin(); it != map.cend(); ++it, ++jt) ok = ok && it->first == jt->first && it->second == jt->second;
+	std::cout << "layout " << map.size() << " " << ok << std::endl;
+}
+
+int main() {
+	test_bounds<int, 256>("int", 1000, -1500000);
+	test_bounds<int, 4096>("int", 1000, -1500000);
+	test_bounds<unsigned, 256>("unsigned", 1000000, 1000);
+	test_bounds<long long, 1024>("long", 3000000000000LL, -4500000000000000LL);
+	test_bounds<unsigned long long, 256>("ulong", 6000000000000000ULL, 5);
+	test_bounds<float, 256>("float", 0.5f, -750.0f);
+	test_bounds<double, 4096>("double", 0.25, -375.0);
+	test_layout();
+	return 0;
+}
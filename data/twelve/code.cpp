@@ -0,0 +1,55 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+
+typedef sjtu::pool_allocator<sjtu::pair<const int, int> > Alloc;
+typedef sjtu::map<int, int, std::less<int>, Alloc, sjtu::compact_nodes> Compact;
+typedef sjtu::map<int, int, std::less<int>, Alloc, sjtu::node_policy<true, true, true> > All;
+
+template<class Map>
+bool same(const Map &map, const std::map<int, int> &ref) {
+	if (map.size() != ref.size()) return false;
+	typename Map::const_iterator it = map.cbegin();
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++it)
+		if (it == map.cend() || it->first != jt->first || it->second != jt->second) return false;
+	if (it != map.cend()) return false;
+	for (std::map<int, int>::const_reverse_iterator jt = ref.rbegin(); jt != ref.rend(); ++jt)
+		if ((--it)->first != jt->first) return false;
+	return true;
+}
+
+//	the balance bits share the parent link; every rebalancing path must keep both right
+template<class Map>
+void test_random(const char *name) {
+	Map map;
+	std::map<int, int> ref;
+	long long seed = 5;
+	bool ok = true;
+	for (int step = 0; step < 200000; ++step) {
+		seed = (seed * 1103515245 + 12345) % 2147483648LL;
+		int key = (seed >> 8) % 5000;
+		switch (seed % 4) {
+			case 0: case 1: map[key] = step; ref[key] = step; break;
+			case 2: map.erase(key); ref.erase(key); break;
+			default: {
+				typename Map::iterator it = map.find(key);
+				if (it != map.end()) { ok = ok && it->second == ref[key]; map.erase(it); ref.erase(key); }
+			}
+		}
+		if (step % 25000 == 0) ok = ok && same(map, ref);
+	}
+	//	ascending and descending runs, the worst cases for rotations
+	for (int i = 10000; i < 20000; ++i) { map[i] = i; ref[i] = i; }
+	for (int i = -1; i > -10000; --i) { map[i] = i; ref[i] = i; }
+	ok = ok && same(map, ref);
+	for (int i = 10000; i < 20000; i += 2) { map.erase(i); ref.erase(i); }
+	Map copy(map);
+	ok = ok && same(copy, ref);
+	std::cout << name << " " << map.size() << " " << ok << " " << same(map, ref) << std::endl;
+}
+
+int main() {
+	test_random<Compact>("compact");
+	test_random<All>("all");
+	return 0;
+}
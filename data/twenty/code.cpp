@@ -0,0 +1,57 @@
+#include "flat_map.hpp"
+#include <iostream>
+#include <string>
+
+//	every lookup of a frozen table against the map it was made from
+template<bool Eytzinger>
+void test_lookups(const char *name, int n) {
+	sjtu::map<int, std::string> map;
+	for (int i = 0; i < n; ++i) map[(i * 7919) % n * 2] = std::to_string(i);
+	sjtu::flat_map<int, std::string, std::less<int>, Eytzinger> flat = sjtu::freeze<Eytzinger>(map);
+	bool ok = flat.size() == map.size();
+	for (int k = -1; k <= 2 * n; ++k) {
+		typename sjtu::map<int, std::string>::const_iterator lo = map.lower_bound(k), up = map.upper_bound(k);
+		ok = ok && flat.count(k) == map.count(k);
+		ok = ok && (flat.lower_bound(k) == flat.cend() ? lo == map.cend() : lo != map.cend() && flat.lower_bound(k)->first == lo->first);
+		ok = ok && (flat.upper_bound(k) == flat.cend() ? up == map.cend() : up != map.cend() && flat.upper_bound(k)->first == up->first);
+		ok = ok && (flat.find(k) == flat.cend() ? !map.count(k) : flat.find(k)->second == map.at(k));
+		ok = ok && flat.equal_range(k).second - flat.equal_range(k).first == long(map.count(k));
+	}
+	long idx = 0;
+	for (typename sjtu::map<int, std::string>::const_iterator it = map.cbegin(); it != map.cend(); ++it, ++idx)
+		ok = ok && (flat.cbegin() + idx)->first == it->first && (*(flat.cbegin() + idx)).second == it->second;
+	ok = ok && flat.cend() - flat.cbegin() == idx;
+	std::cout << name << " " << n << " " << flat.size() << " " << ok << std::endl;
+}
+
+void test_values() {
+	sjtu::map<int, int> map;
+	for (int i = 0; i < 100; ++i) map[i] = i;
+	sjtu::flat_map<int, int> flat(map);
+	flat.at(10) = -10;
+	sjtu::flat_map<int, int> copy(flat);
+	copy.at(20) = -20;
+	std::cout << flat.at(10) << " " << flat.at(20) << " " << copy.at(10) << " " << copy.at(20) << " " << map.at(10) << std::endl;
+	try {
+		flat.at(100);
+	} catch (const sjtu::index_out_of_bound &) {
+		std::cout << "index_out_of_bound" << std::endl;
+	}
+	try {
+		*flat.cend();
+	} catch (const sjtu::invalid_iterator &) {
+		std::cout << "invalid_iterator" << std::endl;
+	}
+	sjtu::flat_map<int, int> empty;
+	std::cout << empty.empty() << " " << (empty.find(1) == empty.cend()) << " " << (empty.lower_bound(0) == empty.cend()) << std::endl;
+}
+
+int main() {
+	test_lookups<false>("binary", 1);
+	test_lookups<false>("binary", 1000);
+	test_lookups<true>("eytzinger", 1);
+	test_lookups<true>("eytzinger", 1000);
+	test_lookups<true>("eytzinger", 1023);
+	test_values();
+	return 0;
+}
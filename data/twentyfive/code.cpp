@@ -0,0 +1,83 @@
+#include "map.hpp"
+#include <iostream>
+#include <cassert>
+#include <vector>
+
+typedef sjtu::map<int, int, std::less<int>, sjtu::pool_allocator<sjtu::pair<const int, int> >, sjtu::deferred_nodes> Map;
+typedef sjtu::pair<const int, int> Value;
+
+//	every key in order, and as many of them as size() says
+bool ordered(const Map &map) {
+	size_t cnt = 0;
+	int last = 0;
+	for (Map::const_iterator it = map.cbegin(); it != map.cend(); ++it, ++cnt) {
+		if (cnt && !(last < it->first)) return false;
+		last = it->first;
+	}
+	return cnt == map.size();
+}
+
+void test_hint_end() {
+	Map map;
+	for (int i = 0; i < 100; i += 2) map.insert(Value(i, i));
+	for (int i = 101; i < 200; i += 2) map.insert_deferred(Value(i, i));
+	map.insert(map.cend(), Value(150, 1));
+	std::cout << map.size() << " " << ordered(map) << " " << map.at(150) << std::endl;
+}
+
+void test_hint_stale_rightmost() {
+	Map map;
+	for (int i = 0; i < 100; i += 2) map.insert(Value(i, i));
+	for (int i = 101; i < 200; i += 2) map.insert_deferred(Value(i, i));
+	map.insert(map.cend(), Value(300, 3));
+	map.insert(map.cend(), Value(200, 2));
+	std::cout << map.size() << " " << ordered(map) << " " << map.count(0) << " " << map.count(101) << " " << (--map.end())->first << std::endl;
+}
+
+void test_hint_middle() {
+	Map map;
+	for (int i = 0; i < 1000; i += 10) map.insert(Value(i, i));
+	for (int i = 5; i < 1000; i += 10) map.insert_deferred(Value(i, i));
+	Map::const_iterator hint = map.cbegin();
+	for (int i = 1; i < 1000; i += 10) hint = map.insert(hint, Value(i, i));
+	map.insert_deferred(Value(7, 7));
+	map.insert(map.cbegin(), Value(3, 3));
+	std::cout << map.size() << " " << ordered(map) << std::endl;
+}
+
+void test_range_into_queued() {
+	Map map;
+	map.insert_deferred(Value(5, 5));
+	std::vector<Value> v;
+	v.push_back(Value(1, 1));
+	v.push_back(Value(2, 2));
+	map.insert(v.begin(), v.end());
+	std::cout << map.size() << " " << map.count(5) << " " << ordered(map) << std::endl;
+
+	map.insert_deferred(Value(2, 20));
+	map.insert_deferred(Value(9, 9));
+	std::vector<Value> w;
+	for (int i = 0; i < 12; ++i) w.push_back(Value(i, -i));
+	map.insert(w.begin(), w.end());
+	std::cout << map.size() << " " << map.at(2) << " " << map.at(9) << " " << map.at(11) << " " << ordered(map) << std::endl;
+}
+
+void test_queue_only() {
+	Map map;
+	for (int i = 0; i < 1000; ++i) map.insert_deferred(Value((i * 7919) % 1000, i));
+	map.insert_deferred(Value(0, -1));
+	std::cout << map.size() << " " << map.at(0) << " " << ordered(map) << std::endl;
+	map.clear();
+	for (int i = 0; i < 10; ++i) map.insert_deferred(Value(i, i));
+	map.clear();
+	std::cout << map.size() << " " << map.empty() << std::endl;
+}
+
+int main() {
+	test_hint_end();
+	test_hint_stale_rightmost();
+	test_hint_middle();
+	test_range_into_queued();
+	test_queue_only();
+	return 0;
+}
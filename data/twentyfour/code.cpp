@@ -0,0 +1,77 @@
+#include "sharded_map.hpp"
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+typedef sjtu::sharded_map<int, long long> Map;
+
+struct add {
+	void operator()(long long &cur, long long &&incoming) const { cur += incoming; }
+};
+
+bool ordered(const Map &map, size_t &cnt, long long &sum) {
+	cnt = 0; sum = 0;
+	int last = 0;
+	bool ok = true;
+	for (Map::const_iterator it = map.cbegin(); it != map.cend(); ++it, ++cnt) {
+		if (cnt) ok = ok && last < it->first;
+		last = it->first;
+		sum += it->second;
+	}
+	return ok;
+}
+
+void test_single() {
+	std::vector<int> sample;
+	for (int i = 0; i < 1000; ++i) sample.push_back(i);
+	Map map(Map::split_keys(sample, 8));
+	std::cout << map.shard_count() << " " << map.empty() << std::endl;
+	for (int i = 0; i < 1000; ++i) map.insert(Map::value_type(i, i));
+	std::cout << map.insert(Map::value_type(5, -1)) << " " << map.insert_or_assign(5, 50LL) << " " << map.insert_or_assign(5000, 1LL) << std::endl;
+	map.update(7, [](long long &v) { v += 100; });
+	map.update(-3, [](long long &v) { v = 3; });
+	std::cout << map.erase(9) << " " << map.erase(9) << " " << map.count(7) << " " << map.count(9) << std::endl;
+	long long v = 0;
+	bool found = map.find(7, v);
+	std::cout << found << " " << v << " " << map.find(9, v) << std::endl;
+	size_t cnt;
+	long long sum;
+	bool ok = ordered(map, cnt, sum);
+	std::cout << map.size() << " " << cnt << " " << sum << " " << ok << std::endl;
+	map.clear();
+	std::cout << map.size() << " " << (map.cbegin() == map.cend()) << std::endl;
+}
+
+//	threads writing overlapping keys; every write lands exactly once
+void test_threads() {
+	std::vector<int> split;
+	for (int i = 1; i < 16; ++i) split.push_back(i * 625);
+	Map map(split);
+	const int threads = 8, per = 20000;
+	std::vector<std::thread> pool;
+	for (int t = 0; t < threads; ++t) {
+		pool.push_back(std::thread([&map, t] {
+			Map::batch<add> batch(map, 64);
+			for (int i = 0; i < per; ++i) {
+				int key = (i * 7 + t * 13) % 10000;
+				if (i % 3 == 0) map.update(key, [](long long &v) { v += 1; });
+				else batch.put(key, 1LL);
+			}
+			batch.flush();
+		}));
+	}
+	for (size_t t = 0; t < pool.size(); ++t) pool[t].join();
+	size_t cnt;
+	long long sum;
+	bool ok = ordered(map, cnt, sum);
+	long long total = 0;
+	map.for_each([&total](Map::value_type &e) { total += e.second; });
+	std::cout << map.size() << " " << cnt << " " << sum << " " << total << " " << ok << std::endl;
+}
+
+int main() {
+	test_single();
+	test_threads();
+	return 0;
+}
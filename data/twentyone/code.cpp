@@ -0,0 +1,98 @@
+#include "map_image.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+template<class Map>
+bool same(const Map &a, const Map &b) {
+	if (a.size() != b.size()) return false;
+	typename Map::const_iterator i = a.cbegin(), j = b.cbegin();
+	for (; i != a.cend(); ++i, ++j)
+		if (i->first != j->first || i->second != j->second) return false;
+	return true;
+}
+
+void test_raw() {
+	sjtu::map<int, long long> map, back;
+	for (int i = 0; i < 10000; ++i) map[(i * 7919) % 10000 * 3] = i * 1000000007LL;
+	std::stringstream buf;
+	sjtu::save(buf, map);
+	back[-1] = -1;
+	sjtu::load(buf, back);
+	std::cout << "raw " << back.size() << " " << same(map, back) << std::endl;
+}
+
+void test_codec() {
+	sjtu::map<std::string, int> map, back;
+	for (int i = 0; i < 1000; ++i) map[std::string(i % 17, 'a') + std::to_string(i)] = i;
+	map[""] = -1;
+	std::stringstream buf;
+	sjtu::save(buf, map);
+	sjtu::load(buf, back);
+	std::cout << "codec " << back.size() << " " << same(map, back) << " " << back.at("") << std::endl;
+}
+
+void test_reject() {
+	sjtu::map<int, long long> map;
+	map[1] = 1;
+	std::stringstream buf;
+	sjtu::save(buf, map);
+	sjtu::map<int, int> other;
+	other[5] = 5;
+	try {
+		sjtu::load(buf, other);
+	} catch (const sjtu::runtime_error &) {
+		std::cout << "rejected " << other.size() << std::endl;
+	}
+	std::stringstream cut(buf.str().substr(0, buf.str().size() - 3));
+	sjtu::map<int, long long> back;
+	try {
+		sjtu::load(cut, back);
+	} catch (const sjtu::runtime_error &) {
+		std::cout << "truncated " << back.size() << std::endl;
+	}
+}
+
+void test_mapped() {
+	const char *path = "map_image_test.bin";
+	sjtu::map<int, double> map;
+	for (int i = 0; i < 5000; ++i) map[i * 2] = i / 4.0;
+	{
+		std::ofstream out(path, std::ios::binary);
+		sjtu::save(out, map);
+	}
+	bool ok;
+	{
+		sjtu::map_image<int, double> image(path);
+		ok = image.size() == map.size();
+		for (int k = -1; k <= 10000; ++k) {
+			ok = ok && image.count(k) == map.count(k);
+			ok = ok && (image.find(k) ? *image.find(k) == map.at(k) : !map.count(k));
+		}
+		sjtu::map<int, double> back;
+		sjtu::load(image, back);
+		ok = ok && same(map, back) && image.at(10) == 1.25;
+		try {
+			image.at(3);
+			ok = false;
+		} catch (const sjtu::index_out_of_bound &) {
+		}
+	}
+	std::remove(path);
+	std::cout << "mapped " << ok << std::endl;
+	try {
+		sjtu::map_image<int, double> missing(path);
+	} catch (const sjtu::runtime_error &) {
+		std::cout << "missing" << std::endl;
+	}
+}
+
+int main() {
+	test_raw();
+	test_codec();
+	test_reject();
+	test_mapped();
+	return 0;
+}
@@ -0,0 +1,78 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+
+typedef sjtu::map<int, int> Map;
+typedef sjtu::map<int, int, std::less<int>, sjtu::pool_allocator<sjtu::pair<const int, int> >, sjtu::threaded_nodes> Threaded;
+
+//	collects what a scan visits, and stops after limit elements
+struct Collect {
+	std::vector<int> *keys;
+	size_t limit;
+	bool operator()(const sjtu::pair<const int, int> &v) const {
+		keys->push_back(v.first);
+		return keys->size() < limit;
+	}
+};
+
+//	the keys of [lo, hi) in std::map, at most limit of them
+std::vector<int> expect(const std::map<int, int> &ref, int lo, int hi, size_t limit) {
+	std::vector<int> keys;
+	if (lo >= hi) return keys;
+	for (std::map<int, int>::const_iterator it = ref.lower_bound(lo); it != ref.end() && it->first < hi && keys.size() < limit; ++it)
+		keys.push_back(it->first);
+	return keys;
+}
+
+template<class M>
+void test(const char *name) {
+	M map;
+	std::map<int, int> ref;
+	std::srand(30);
+	for (int i = 0; i < 30000; ++i) {
+		int k = std::rand() % 60000;
+		map[k] = i;
+		ref[k] = i;
+	}
+	bool ok = true;
+	long sum = 0;
+	for (int round = 0; round < 400; ++round) {
+		int lo = std::rand() % 62000 - 1000, hi = lo + std::rand() % (round % 10 ? 300 : 70000) - 20;
+		size_t limit = round % 3 ? size_t(-1) : std::rand() % 50;
+		std::vector<int> want = expect(ref, lo, hi, limit), got;
+		//	a scan that returns bool stops early, a void one runs to hi
+		Collect c = {&got, limit ? limit : 1};
+		size_t seen = map.scan(lo, hi, c);
+		std::vector<int> first = expect(ref, lo, hi, limit ? limit : 1);
+		ok = ok && got == first && seen == first.size();
+		size_t all = static_cast<const M &>(map).scan(lo, hi, [&](const sjtu::pair<const int, int> &v) { sum += v.second; });
+		ok = ok && all == expect(ref, lo, hi, size_t(-1)).size();
+		//	the same range through a cursor, in batches of every size
+		got.clear();
+		typename M::cursor cur = map.range(lo, hi);
+		typename M::value_type *buf[13];
+		size_t cap = round % 13 + 1;
+		for (size_t n; (n = cur.next(buf, cap));) {
+			ok = ok && n <= cap;
+			for (size_t i = 0; i < n; ++i) got.push_back(buf[i]->first);
+		}
+		ok = ok && cur.done() && cur.next(buf, cap) == 0 && got == expect(ref, lo, hi, size_t(-1));
+	}
+	//	a scan may change mapped values
+	map.scan(100, 200, [](sjtu::pair<const int, int> &v) { v.second = -1; });
+	for (std::map<int, int>::iterator it = ref.lower_bound(100); it != ref.end() && it->first < 200; ++it) it->second = -1;
+	typename M::const_cursor all = static_cast<const M &>(map).range(-1, 70000);
+	const typename M::value_type *one[1];
+	std::map<int, int>::iterator jt = ref.begin();
+	for (; all.next(one, 1); ++jt) ok = ok && jt != ref.end() && one[0]->first == jt->first && one[0]->second == jt->second;
+	ok = ok && jt == ref.end();
+	std::cout << name << " " << ok << " " << sum << std::endl;
+}
+
+int main() {
+	test<Map>("plain");
+	test<Threaded>("threaded");
+	return 0;
+}
@@ -0,0 +1,122 @@
+#include "map.hpp"
+#include <iostream>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include <stdexcept>
+
+typedef sjtu::map<int, int> Map;
+typedef sjtu::map<int, int, std::less<int>, sjtu::pool_allocator<sjtu::pair<const int, int> >, sjtu::sized_nodes> Sized;
+
+template<class M>
+bool same(const M &map, const std::map<int, int> &ref) {
+	if (map.size() != ref.size()) return false;
+	typename M::const_iterator it = map.cbegin();
+	for (std::map<int, int>::const_iterator jt = ref.begin(); jt != ref.end(); ++jt, ++it)
+		if (it->first != jt->first || it->second != jt->second) return false;
+	return it == map.cend();
+}
+
+//	a value whose copies may throw and whose moves are not noexcept
+struct Fragile {
+	static int budget;
+	int v;
+	Fragile(int v) : v(v) {}
+	Fragile(const Fragile &o) : v(o.v) {
+		if (budget >= 0 && budget-- == 0) throw std::runtime_error("copy");
+	}
+	Fragile(Fragile &&o) : v(o.v) {}
+	Fragile &operator=(const Fragile &o) {
+		v = o.v;
+		return *this;
+	}
+};
+int Fragile::budget = -1;
+
+//	erase most of a map, compact it, and it still agrees with std::map
+template<class M>
+void test_compact(const char *name) {
+	M map;
+	std::map<int, int> ref;
+	std::srand(26);
+	for (int i = 0; i < 100000; ++i) {
+		int k = std::rand();
+		map[k] = i;
+		ref[k] = i;
+	}
+	for (std::map<int, int>::iterator it = ref.begin(); it != ref.end();) {
+		if (it->second % 4) {
+			map.erase(map.find(it->first));
+			ref.erase(it++);
+		} else {
+			++it;
+		}
+	}
+	sjtu::map_memory before = map.memory_usage();
+	map.compact();
+	sjtu::map_memory after = map.memory_usage();
+	bool ok = same(map, ref);
+	ok = ok && after.nodes == ref.size() && before.nodes == ref.size() && after.node_bytes == before.node_bytes;
+	ok = ok && after.slack_bytes < before.slack_bytes && after.slack_bytes * 10 < after.node_bytes;
+	ok = ok && after.value_bytes == ref.size() * sizeof(typename M::value_type) && after.payload_bytes == 0;
+	//	the compacted tree takes changes as before
+	for (int i = 0; i < 20000; ++i) {
+		int k = std::rand() % 1000;
+		if (i % 3) { map[k] = i; ref[k] = i; }
+		else if (ref.erase(k)) map.erase(map.find(k));
+	}
+	ok = ok && same(map, ref);
+	M empty;
+	empty.compact();
+	empty[1] = 1;
+	ok = ok && empty.size() == 1 && empty.memory_usage().nodes == 1;
+	std::cout << name << " " << ok << std::endl;
+}
+
+void test_rank() {
+	Sized map;
+	for (int i = 0; i < 1000; ++i) map[i * 3] = i;
+	for (int i = 0; i < 1000; i += 2) map.erase(map.find(i * 3));
+	map.compact();
+	std::cout << map.rank(30) << " " << map.select(100)->first << " " << map.index_of(map.find(303)) << std::endl;
+}
+
+//	copying values into the new nodes throws: the map is left as it was
+void test_throw() {
+	sjtu::map<int, Fragile> map;
+	for (int i = 0; i < 500; ++i) map.insert(sjtu::pair<const int, Fragile>(i, Fragile(i)));
+	for (int i = 0; i < 500; i += 2) map.erase(map.find(i));
+	Fragile::budget = 100;
+	bool thrown = false;
+	try {
+		map.compact();
+	} catch (const std::runtime_error &) {
+		thrown = true;
+	}
+	Fragile::budget = -1;
+	long sum = 0;
+	for (sjtu::map<int, Fragile>::iterator it = map.begin(); it != map.end(); ++it) sum += it->second.v;
+	map.compact();
+	map.insert(sjtu::pair<const int, Fragile>(999, Fragile(1)));
+	std::cout << thrown << " " << map.size() << " " << sum << std::endl;
+}
+
+//	std::string keys report the heap they own, short ones none
+void test_payload() {
+	sjtu::map<std::string, int> map;
+	map["short"] = 1;
+	size_t small = map.memory_usage().payload_bytes;
+	map[std::string(1000, 'x')] = 2;
+	size_t large = map.memory_usage().payload_bytes;
+	size_t custom = map.memory_usage([](const sjtu::pair<const std::string, int> &v) { return size_t(v.second); }).payload_bytes;
+	std::cout << small << " " << (large > 1000) << " " << custom << std::endl;
+}
+
+int main() {
+	test_compact<Map>("plain");
+	test_compact<Sized>("sized");
+	test_rank();
+	test_throw();
+	test_payload();
+	return 0;
+}
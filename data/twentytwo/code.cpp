@@ -0,0 +1,44 @@
+#include "map.hpp"
+#include <iostream>
+
+typedef sjtu::pool_allocator<sjtu::pair<const int, int> > Alloc;
+typedef sjtu::map<int, int, std::less<int>, Alloc, sjtu::counted_nodes> Counted;
+typedef sjtu::map<int, int, std::less<int>, Alloc, sjtu::node_policy<false, false, false, true, true> > Timed;
+
+size_t total(const size_t *histogram) {
+	size_t s = 0;
+	for (int i = 0; i < sjtu::map_stats::buckets; ++i) s += histogram[i];
+	return s;
+}
+
+template<class Map>
+void test_counts(const char *name) {
+	Map map;
+	for (int i = 0; i < 1000; ++i) map.insert(sjtu::pair<const int, int>(i, i));
+	sjtu::map_stats s = map.stats();
+	//	ascending inserts rotate left only, each one a single rotation
+	std::cout << name << " " << s.allocations << " " << s.frees << " " << (s.comparisons > 0) << " "
+	          << (s.left_rotations > 0) << " " << s.right_rotations << " " << (s.single_rotations == s.left_rotations) << " "
+	          << s.double_rotations << " " << total(s.depth) << std::endl;
+
+	map.reset_stats();
+	for (int i = 0; i < 1000; i += 2) map.erase(i);
+	for (int i = 0; i < 100; ++i) map.find(i);
+	int steps = 0;
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it) ++steps;
+	s = map.stats();
+	std::cout << name << " " << s.allocations << " " << s.frees << " " << total(s.depth) << " " << total(s.climb) << " " << steps << std::endl;
+	std::cout << name << " " << s.inserts << " " << s.erases << " " << s.finds << " "
+	          << (s.erase_cycles > 0) << " " << (s.find_cycles > 0) << std::endl;
+
+	Map copy(map);
+	std::cout << name << " " << copy.stats().comparisons << " " << copy.stats().allocations << " " << (map.stats().comparisons > 0) << std::endl;
+	map.reset_stats();
+	std::cout << name << " " << map.stats().comparisons << " " << map.stats().frees << " " << total(map.stats().depth) << std::endl;
+}
+
+int main() {
+	test_counts<Counted>("counted");
+	test_counts<Timed>("timed");
+	return 0;
+}
@@ -0,0 +1,934 @@
+/**
+ * a B+-tree with the interface of sjtu::map.
+ *
+ * keys are packed into arrays inside nodes of about NodeBytes bytes, so a
+ * lookup touches one or two cache lines per level instead of one per key.
+ * values live in separately allocated records that never move; every
+ * record knows its leaf and slot, so iterators stay valid across inserts
+ * and erases exactly like the node-based map's.
+ *
+ * use it as sjtu::btree_map<Key, T> or through the layout tag:
+ *   sjtu::map<Key, T, Compare, Allocator, sjtu::btree_layout<> >
+ *
+ * not part of the OJ submission; map.hpp does not depend on this file.
+ */
+#ifndef SJTU_BTREE_MAP_HPP
+#define SJTU_BTREE_MAP_HPP
+
+#include "map.hpp"
+#include "btree_simd.hpp"
+
+namespace sjtu {
+
+/**
+ * node layout tag for sjtu::map: a B+-tree whose nodes are about NodeBytes
+ * bytes (four cache lines by default).
+ */
+template<size_t NodeBytes = 256>
+struct btree_layout {};
+
+namespace detail {
+
+// entries of `per` bytes fitting in `bytes` after a `head` byte header, at least 5
+constexpr size_t btree_fit(size_t bytes, size_t head, size_t per) {
+  return bytes > head + 5 * per ? (bytes - head) / per : 5;
+}
+
+// searches inside one node: the first slot whose key is not less than key
+// (lower) or greater than key (upper)
+template<class Key, class Compare>
+struct btree_binary_search {
+  template<class K>
+  static int lower(const Key *keys, int cnt, const K &key, const Compare &comp) {
+    int lo = 0, hi = cnt;
+    while (lo < hi) {
+      int mid = (lo + hi) >> 1;
+      if (comp(keys[mid], key)) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+  template<class K>
+  static int upper(const Key *keys, int cnt, const K &key, const Compare &comp) {
+    int lo = 0, hi = cnt;
+    while (lo < hi) {
+      int mid = (lo + hi) >> 1;
+      if (comp(key, keys[mid])) hi = mid;
+      else lo = mid + 1;
+    }
+    return lo;
+  }
+};
+
+template<class Key, class Compare>
+struct btree_search : btree_binary_search<Key, Compare> {};
+
+// std::less over a key simd_count knows: compare the probe against the node's
+// keys in vector registers and count, no branch per key. the keys are sorted,
+// so the number of keys less than (not greater than) key is the slot. big
+// nodes are first halved down to a window of at most 32 keys.
+template<class Key, bool Vector = simd_count<Key>::enabled>
+struct less_search : btree_binary_search<Key, std::less<Key> > {};
+template<class Key>
+struct less_search<Key, true> {
+  template<bool Eq>
+  static int search(const Key *keys, int cnt, const Key &key) {
+    int lo = 0;
+    while (cnt > 32) {
+      int half = cnt >> 1;
+      if (Eq ? !(key < keys[lo + half]) : keys[lo + half] < key) { lo += half + 1; cnt -= half + 1; }
+      else cnt = half;
+    }
+    return lo + simd_count<Key>::template count<Eq>(keys + lo, cnt, key);
+  }
+  static int lower(const Key *keys, int cnt, const Key &key, const std::less<Key> &) { return search<false>(keys, cnt, key); }
+  static int upper(const Key *keys, int cnt, const Key &key, const std::less<Key> &) { return search<true>(keys, cnt, key); }
+};
+template<class Key>
+struct btree_search<Key, std::less<Key> > : less_search<Key> {};
+
+}
+
+template<
+    class Key,
+    class T,
+    class Compare = std::less<Key>,
+    class Allocator = pool_allocator<pair<const Key, T> >,
+    size_t NodeBytes = 256
+> class btree_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+  private:
+   struct Leaf;
+   struct Inner;
+   struct Base {
+     Inner *parent;
+     int count;  // entries in a leaf, children in an inner node
+     bool leaf;
+   };
+   // values are out of line so splits and merges only move keys and pointers
+   struct Elem {
+     value_type value;
+     Leaf *leaf;
+     int slot;
+     template<class... Args>
+     Elem(Leaf *l, Args &&... args) : value(std::forward<Args>(args)...), leaf(l), slot(0) {}
+   };
+
+   // one slot more than the capacity: a node overflows by one and is split afterwards
+   static const int leafSlots = int(detail::btree_fit(NodeBytes, sizeof(Base) + 2 * sizeof(void *), sizeof(Key) + sizeof(void *)));
+   static const int innerSlots = int(detail::btree_fit(NodeBytes + sizeof(Key), sizeof(Base), sizeof(Key) + sizeof(void *)));
+   static const int leafCap = leafSlots - 1;
+   static const int innerCap = innerSlots - 1;
+   static const int leafMin = leafCap / 2;
+   static const int innerMin = innerCap / 2;
+
+   struct Leaf : Base {
+     Leaf *prev, *next;
+     alignas(Key) unsigned char keyBuf[leafSlots * sizeof(Key)];
+     Elem *elem[leafSlots];
+     Key *keys() { return reinterpret_cast<Key *>(keyBuf); }
+     const Key *keys() const { return reinterpret_cast<const Key *>(keyBuf); }
+   };
+   struct Inner : Base {
+     alignas(Key) unsigned char keyBuf[(innerSlots - 1) * sizeof(Key)];
+     Base *child[innerSlots];
+     Key *keys() { return reinterpret_cast<Key *>(keyBuf); }
+     const Key *keys() const { return reinterpret_cast<const Key *>(keyBuf); }
+   };
+
+   typedef typename detail::rebind_alloc<Allocator, Elem>::type ElemAllocator;
+   typedef typename detail::rebind_alloc<Allocator, Leaf>::type LeafAllocator;
+   typedef typename detail::rebind_alloc<Allocator, Inner>::type InnerAllocator;
+   typedef detail::btree_search<Key, Compare> Search;
+
+   Base *root = nullptr;
+   Leaf *head = nullptr;  // leaf chain, in key order
+   Leaf *tail = nullptr;
+   size_t n = 0;
+   Compare comp = Compare();
+   ElemAllocator elemAlloc;
+   LeafAllocator leafAlloc;
+   InnerAllocator innerAlloc;
+
+   template<class... Args>
+   Elem *createElem(Args &&... args) {
+     Elem *e = elemAlloc.allocate(1);
+     try {
+       new (e) Elem(nullptr, std::forward<Args>(args)...);
+     } catch (...) {
+       elemAlloc.deallocate(e, 1);
+       throw;
+     }
+     return e;
+   }
+   void destroyElem(Elem *e) {
+     e->~Elem();
+     elemAlloc.deallocate(e, 1);
+   }
+   Leaf *createLeaf() {
+     Leaf *l = leafAlloc.allocate(1);
+     l->parent = nullptr; l->count = 0; l->leaf = true;
+     l->prev = l->next = nullptr;
+     return l;
+   }
+   Inner *createInner() {
+     Inner *x = innerAlloc.allocate(1);
+     x->parent = nullptr; x->count = 0; x->leaf = false;
+     return x;
+   }
+
+   // keys are moved by construct + destroy: Key need not be assignable
+   static void moveKey(Key *dst, Key *src) {
+     new (dst) Key(std::move(*src));
+     src->~Key();
+   }
+   static void moveKeys(Key *dst, Key *src, int cnt) {
+     if (dst > src) for (int i = cnt - 1; i >= 0; --i) moveKey(dst + i, src + i);
+     else for (int i = 0; i < cnt; ++i) moveKey(dst + i, src + i);
+   }
+   static void setKey(Key *dst, const Key &src) {
+     Key k(src);
+     dst->~Key();
+     new (dst) Key(std::move(k));
+   }
+   static void moveEntry(Leaf *dst, int d, Leaf *src, int s) {
+     moveKey(dst->keys() + d, src->keys() + s);
+     Elem *e = src->elem[s];
+     dst->elem[d] = e; e->leaf = dst; e->slot = d;
+   }
+   static void moveEntries(Leaf *dst, int d, Leaf *src, int s, int cnt) {
+     if (dst == src && d > s) for (int i = cnt - 1; i >= 0; --i) moveEntry(dst, d + i, src, s + i);
+     else for (int i = 0; i < cnt; ++i) moveEntry(dst, d + i, src, s + i);
+   }
+   static void moveChildren(Inner *dst, int d, Inner *src, int s, int cnt) {
+     if (dst == src && d > s) for (int i = cnt - 1; i >= 0; --i) { dst->child[d + i] = src->child[s + i]; dst->child[d + i]->parent = dst; }
+     else for (int i = 0; i < cnt; ++i) { dst->child[d + i] = src->child[s + i]; dst->child[d + i]->parent = dst; }
+   }
+   static int childIndex(const Inner *p, const Base *x) {
+     int i = 0;
+     while (p->child[i] != x) ++i;
+     return i;
+   }
+
+   template<class K>
+   Leaf *leafFor(const K &key) const {
+     Base *x = root;
+     if (!x) return nullptr;
+     while (!x->leaf) {
+       Inner *in = static_cast<Inner *>(x);
+       x = in->child[Search::upper(in->keys(), in->count - 1, key, comp)];
+     }
+     return static_cast<Leaf *>(x);
+   }
+   template<class K>
+   Elem *findElem(const K &key) const {
+     Leaf *l = leafFor(key);
+     if (!l) return nullptr;
+     int i = Search::lower(l->keys(), l->count, key, comp);
+     if (i < l->count && !comp(key, l->keys()[i])) return l->elem[i];
+     return nullptr;
+   }
+   // the answer is in the leaf covering key or starts the next one
+   template<class K>
+   Elem *lowerElem(const K &key) const {
+     Leaf *l = leafFor(key);
+     if (!l) return nullptr;
+     int i = Search::lower(l->keys(), l->count, key, comp);
+     if (i < l->count) return l->elem[i];
+     return l->next ? l->next->elem[0] : nullptr;
+   }
+   template<class K>
+   Elem *upperElem(const K &key) const {
+     Leaf *l = leafFor(key);
+     if (!l) return nullptr;
+     int i = Search::upper(l->keys(), l->count, key, comp);
+     if (i < l->count) return l->elem[i];
+     return l->next ? l->next->elem[0] : nullptr;
+   }
+
+   Elem *firstElem() const { return head ? head->elem[0] : nullptr; }
+   Elem *lastElem() const { return tail ? tail->elem[tail->count - 1] : nullptr; }
+   static Elem *successor(const Elem *e) {
+     Leaf *l = e->leaf;
+     if (e->slot + 1 < l->count) return l->elem[e->slot + 1];
+     return l->next ? l->next->elem[0] : nullptr;
+   }
+   static Elem *predecessor(const Elem *e) {
+     Leaf *l = e->leaf;
+     if (e->slot > 0) return l->elem[e->slot - 1];
+     return l->prev ? l->prev->elem[l->prev->count - 1] : nullptr;
+   }
+
+   // where key goes: its leaf and slot, or the element already holding it.
+   // appends past the largest key skip the descent.
+   Elem *findInsertPos(const Key &key, Leaf *&l, int &slot) const {
+     if (tail && comp(tail->keys()[tail->count - 1], key)) {
+       l = tail; slot = tail->count;
+       return nullptr;
+     }
+     l = leafFor(key);
+     if (!l) { slot = 0; return nullptr; }
+     slot = Search::lower(l->keys(), l->count, key, comp);
+     if (slot < l->count && !comp(key, l->keys()[slot])) return l->elem[slot];
+     return nullptr;
+   }
+
+   // put e at slot of l (l == nullptr: the tree is empty), splitting upwards.
+   // the nodes the splits need and the separator the leaf passes up are made
+   // before anything changes, so if that throws the tree is as it was; after
+   // that only keys are moved, and moving a key must not throw.
+   void linkElem(Elem *e, Leaf *l, int slot) {
+     Key k(e->value.first);
+     if (!l) {
+       l = createLeaf();
+       root = head = tail = l;
+     }
+     if (l->count < leafCap) {
+       placeElem(e, l, slot, std::move(k));
+       return;
+     }
+     // appending in order fills leaves completely instead of leaving them half empty
+     bool append = l == tail && slot == leafCap;
+     int keep = append ? leafCap : (leafCap + 1) / 2;
+     Key sep(keep < slot ? l->keys()[keep] : keep == slot ? k : l->keys()[keep - 1]);
+     Leaf *r = createLeaf();
+     Inner *spare = nullptr;  // one for every full ancestor, and one for a new root
+     try {
+       for (Inner *p = l->parent; !p || p->count == innerCap; p = p->parent) {
+         Inner *x = createInner();
+         x->child[0] = spare;
+         spare = x;
+         if (!p) break;
+       }
+     } catch (...) {
+       leafAlloc.deallocate(r, 1);
+       while (spare) { Inner *x = spare; spare = static_cast<Inner *>(x->child[0]); innerAlloc.deallocate(x, 1); }
+       throw;
+     }
+     placeElem(e, l, slot, std::move(k));
+     splitLeaf(l, r, keep, std::move(sep), append, spare);
+   }
+   void placeElem(Elem *e, Leaf *l, int slot, Key &&k) {
+     moveEntries(l, slot + 1, l, slot, l->count - slot);
+     new (l->keys() + slot) Key(std::move(k));
+     l->elem[slot] = e; e->leaf = l; e->slot = slot;
+     ++l->count;
+     ++n;
+   }
+   static Inner *takeSpare(Inner *&spare) {
+     Inner *x = spare;
+     spare = static_cast<Inner *>(x->child[0]);
+     return x;
+   }
+   // sep is a copy of the first key r gets
+   void splitLeaf(Leaf *l, Leaf *r, int keep, Key &&sep, bool append, Inner *&spare) {
+     moveEntries(r, 0, l, keep, l->count - keep);
+     r->count = l->count - keep;
+     l->count = keep;
+     r->prev = l; r->next = l->next;
+     if (l->next) l->next->prev = r;
+     else tail = r;
+     l->next = r;
+     insertChild(l, std::move(sep), r, append, spare);
+   }
+   // link right after left under left's parent, with sep between them
+   void insertChild(Base *left, Key &&sep, Base *right, bool append, Inner *&spare) {
+     Inner *p = left->parent;
+     if (!p) {
+       p = takeSpare(spare);
+       new (p->keys()) Key(std::move(sep));
+       p->child[0] = left; p->child[1] = right; p->count = 2;
+       left->parent = right->parent = p;
+       root = p;
+       return;
+     }
+     int i = childIndex(p, left);
+     moveKeys(p->keys() + i + 1, p->keys() + i, p->count - 1 - i);
+     new (p->keys() + i) Key(std::move(sep));
+     moveChildren(p, i + 2, p, i + 1, p->count - 1 - i);
+     p->child[i + 1] = right; right->parent = p;
+     if (++p->count > innerCap) {
+       // an appended inner node keeps two children on the right, never one
+       append = append && i + 2 == p->count;
+       splitInner(p, append ? p->count - 2 : p->count / 2, append, spare);
+     }
+   }
+   void splitInner(Inner *p, int keep, bool append, Inner *&spare) {
+     Inner *q = takeSpare(spare);
+     int cnt = p->count;
+     Key up(std::move(p->keys()[keep - 1]));
+     p->keys()[keep - 1].~Key();
+     moveKeys(q->keys(), p->keys() + keep, cnt - 1 - keep);
+     moveChildren(q, 0, p, keep, cnt - keep);
+     q->count = cnt - keep;
+     p->count = keep;
+     insertChild(p, std::move(up), q, append, spare);
+   }
+
+   void unlinkLeaf(Leaf *l) {
+     if (l->prev) l->prev->next = l->next;
+     else head = l->next;
+     if (l->next) l->next->prev = l->prev;
+     else tail = l->prev;
+     leafAlloc.deallocate(l, 1);
+   }
+   void eraseElem(Elem *e) {
+     Leaf *l = e->leaf;
+     int i = e->slot;
+     l->keys()[i].~Key();
+     moveEntries(l, i, l, i + 1, l->count - i - 1);
+     --l->count;
+     destroyElem(e);
+     --n;
+     if (l == root) {
+       if (l->count == 0) {
+         leafAlloc.deallocate(l, 1);
+         root = head = tail = nullptr;
+       }
+     } else if (l->count < leafMin) fixLeaf(l);
+   }
+   // borrow an entry from a sibling, or merge with one
+   void fixLeaf(Leaf *l) {
+     Inner *p = l->parent;
+     int i = childIndex(p, l);
+     Leaf *left = i > 0 ? static_cast<Leaf *>(p->child[i - 1]) : nullptr;
+     Leaf *right = i + 1 < p->count ? static_cast<Leaf *>(p->child[i + 1]) : nullptr;
+     if (left && left->count > leafMin) {
+       moveEntries(l, 1, l, 0, l->count);
+       moveEntry(l, 0, left, left->count - 1);
+       --left->count; ++l->count;
+       setKey(p->keys() + i - 1, l->keys()[0]);
+     } else if (right && right->count > leafMin) {
+       moveEntry(l, l->count, right, 0);
+       moveEntries(right, 0, right, 1, right->count - 1);
+       --right->count; ++l->count;
+       setKey(p->keys() + i, right->keys()[0]);
+     } else if (left) {
+       moveEntries(left, left->count, l, 0, l->count);
+       left->count += l->count;
+       unlinkLeaf(l);
+       p->keys()[i - 1].~Key();
+       dropChild(p, i);
+     } else {
+       moveEntries(l, l->count, right, 0, right->count);
+       l->count += right->count;
+       unlinkLeaf(right);
+       p->keys()[i].~Key();
+       dropChild(p, i + 1);
+     }
+   }
+   // remove child i of p whose separator (key i - 1) is already gone
+   void dropChild(Inner *p, int i) {
+     moveKeys(p->keys() + i - 1, p->keys() + i, p->count - 1 - i);
+     moveChildren(p, i, p, i + 1, p->count - 1 - i);
+     --p->count;
+     if (p == root) {
+       if (p->count == 1) {
+         root = p->child[0];
+         root->parent = nullptr;
+         innerAlloc.deallocate(p, 1);
+       }
+     } else if (p->count < innerMin) fixInner(p);
+   }
+   // as fixLeaf; separators rotate through the parent
+   void fixInner(Inner *p) {
+     Inner *g = p->parent;
+     int i = childIndex(g, p);
+     Inner *left = i > 0 ? static_cast<Inner *>(g->child[i - 1]) : nullptr;
+     Inner *right = i + 1 < g->count ? static_cast<Inner *>(g->child[i + 1]) : nullptr;
+     if (left && left->count > innerMin) {
+       int last = left->count - 1;  // read once: the compiler cannot tell that the key moves keep it
+       moveKeys(p->keys() + 1, p->keys(), p->count - 1);
+       moveKey(p->keys(), g->keys() + i - 1);
+       moveKey(g->keys() + i - 1, left->keys() + last - 1);
+       moveChildren(p, 1, p, 0, p->count);
+       moveChildren(p, 0, left, last, 1);
+       --left->count; ++p->count;
+     } else if (right && right->count > innerMin) {
+       moveKey(p->keys() + p->count - 1, g->keys() + i);
+       moveKey(g->keys() + i, right->keys());
+       moveKeys(right->keys(), right->keys() + 1, right->count - 2);
+       moveChildren(p, p->count, right, 0, 1);
+       moveChildren(right, 0, right, 1, right->count - 1);
+       --right->count; ++p->count;
+     } else if (left) {
+       moveKey(left->keys() + left->count - 1, g->keys() + i - 1);
+       moveKeys(left->keys() + left->count, p->keys(), p->count - 1);
+       moveChildren(left, left->count, p, 0, p->count);
+       left->count += p->count;
+       innerAlloc.deallocate(p, 1);
+       dropChild(g, i);
+     } else {
+       moveKey(p->keys() + p->count - 1, g->keys() + i);
+       moveKeys(p->keys() + p->count, right->keys(), right->count - 1);
+       moveChildren(p, p->count, right, 0, right->count);
+       p->count += right->count;
+       innerAlloc.deallocate(right, 1);
+       dropChild(g, i + 1);
+     }
+   }
+
+   void destroy(Base *x) {
+     if (x->leaf) {
+       Leaf *l = static_cast<Leaf *>(x);
+       for (int i = 0; i < l->count; ++i) { l->keys()[i].~Key(); destroyElem(l->elem[i]); }
+       leafAlloc.deallocate(l, 1);
+       return;
+     }
+     Inner *in = static_cast<Inner *>(x);
+     for (int i = 0; i < in->count; ++i) destroy(in->child[i]);
+     for (int i = 0; i + 1 < in->count; ++i) in->keys()[i].~Key();
+     innerAlloc.deallocate(in, 1);
+   }
+   // other's elements in order; every one lands at the end of the last leaf
+   void copyFrom(const btree_map &other) {
+     try {
+       for (Elem *e = other.firstElem(); e; e = successor(e)) linkElem(createElem(e->value), tail, tail ? tail->count : 0);
+     } catch (...) {
+       clear();
+       throw;
+     }
+   }
+   void steal(btree_map &other) {
+     root = other.root; head = other.head; tail = other.tail; n = other.n;
+     other.root = nullptr; other.head = other.tail = nullptr; other.n = 0;
+   }
+
+   template<class... Args>
+   pair<Elem *, bool> emplaceKey(const Key &key, Args &&... args) {
+     Leaf *l; int slot;
+     Elem *e = findInsertPos(key, l, slot);
+     if (e) return pair<Elem *, bool>(e, false);
+     e = createElem(std::forward<Args>(args)...);
+     try {
+       linkElem(e, l, slot);
+     } catch (...) {
+       destroyElem(e);
+       throw;
+     }
+     return pair<Elem *, bool>(e, true);
+   }
+
+  public:
+   class const_iterator;
+   class iterator {
+      private:
+       Elem *cur = nullptr;
+       const btree_map *owner = nullptr;
+      public:
+       iterator() {}
+
+       iterator(Elem *c, const btree_map *o) : cur(c), owner(o) {}
+
+       iterator(const iterator &other) : cur(other.cur), owner(other.owner) {}
+
+       iterator &operator=(const iterator &other) = default;
+
+       iterator operator++(int) {
+         iterator tmp = *this;
+         ++*this;
+         return tmp;
+       }
+       iterator &operator++() {
+         if (!owner || cur == nullptr) throw invalid_iterator();
+         cur = successor(cur);
+         return *this;
+       }
+       iterator operator--(int) {
+         iterator tmp = *this;
+         --*this;
+         return tmp;
+       }
+       iterator &operator--() {
+         if (!owner) throw invalid_iterator();
+         if (cur == nullptr) {
+           if (!owner->tail) throw invalid_iterator();
+           cur = owner->lastElem();
+           return *this;
+         }
+         if (cur == owner->firstElem()) throw invalid_iterator();
+         cur = predecessor(cur);
+         return *this;
+       }
+
+       value_type &operator*() const {
+         if (!owner || cur == nullptr) throw invalid_iterator();
+         return cur->value;
+       }
+       value_type *operator->() const noexcept {
+         if (!owner || cur == nullptr) return nullptr;
+         return &cur->value;
+       }
+
+       bool operator==(const iterator &rhs) const { return owner == rhs.owner && cur == rhs.cur; }
+       bool operator==(const const_iterator &rhs) const { return owner == rhs.owner && cur == rhs.cur; }
+       bool operator!=(const iterator &rhs) const { return !(*this == rhs); }
+       bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+
+       friend class btree_map;
+   };
+   class const_iterator {
+      private:
+       Elem *cur = nullptr;
+       const btree_map *owner = nullptr;
+      public:
+       const_iterator() {}
+
+       const_iterator(Elem *c, const btree_map *o) : cur(c), owner(o) {}
+
+       const_iterator(const const_iterator &other) : cur(other.cur), owner(other.owner) {}
+
+       const_iterator(const iterator &other) : cur(other.cur), owner(other.owner) {}
+
+       const_iterator &operator=(const const_iterator &other) = default;
+
+       const_iterator operator++(int) {
+         const_iterator tmp = *this;
+         ++*this;
+         return tmp;
+       }
+       const_iterator &operator++() {
+         if (!owner || cur == nullptr) throw invalid_iterator();
+         cur = successor(cur);
+         return *this;
+       }
+       const_iterator operator--(int) {
+         const_iterator tmp = *this;
+         --*this;
+         return tmp;
+       }
+       const_iterator &operator--() {
+         if (!owner) throw invalid_iterator();
+         if (cur == nullptr) {
+           if (!owner->tail) throw invalid_iterator();
+           cur = owner->lastElem();
+           return *this;
+         }
+         if (cur == owner->firstElem()) throw invalid_iterator();
+         cur = predecessor(cur);
+         return *this;
+       }
+
+       const value_type &operator*() const {
+         if (!owner || cur == nullptr) throw invalid_iterator();
+         return cur->value;
+       }
+       const value_type *operator->() const noexcept {
+         if (!owner || cur == nullptr) return nullptr;
+         return &cur->value;
+       }
+
+       bool operator==(const const_iterator &rhs) const { return owner == rhs.owner && cur == rhs.cur; }
+       bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+       bool operator==(const iterator &rhs) const { return owner == rhs.owner && cur == rhs.cur; }
+       bool operator!=(const iterator &rhs) const { return !(*this == rhs); }
+
+       friend class btree_map;
+   };
+
+   btree_map() {}
+
+   btree_map(const btree_map &other) : comp(other.comp) { copyFrom(other); }
+
+   btree_map(btree_map &&other)
+       : comp(other.comp), elemAlloc(other.elemAlloc), leafAlloc(other.leafAlloc), innerAlloc(other.innerAlloc) {
+     steal(other);
+   }
+
+   /**
+  * build from a range of value_type; if a key is repeated the first one wins.
+  * input sorted by key only ever touches the last leaf.
+    */
+   template<class InputIt>
+   btree_map(InputIt first, InputIt last) {
+     try {
+       for (; first != last; ++first) insert(*first);
+     } catch (...) {
+       clear();
+       throw;
+     }
+   }
+
+   btree_map &operator=(const btree_map &other) {
+     if (this == &other) return *this;
+     clear();
+     comp = other.comp;
+     copyFrom(other);
+     return *this;
+   }
+
+   btree_map &operator=(btree_map &&other) {
+     if (this == &other) return *this;
+     clear();
+     comp = other.comp;
+     elemAlloc = other.elemAlloc; leafAlloc = other.leafAlloc; innerAlloc = other.innerAlloc;
+     steal(other);
+     return *this;
+   }
+
+   ~btree_map() { clear(); }
+
+   /**
+  * access specified element with bounds checking
+  * Returns a reference to the mapped value of the element with key equivalent to key.
+  * If no such element exists, an exception of type `index_out_of_bound'
+    */
+   T &at(const Key &key) {
+     Elem *e = findElem(key);
+     if (!e) throw index_out_of_bound();
+     return e->value.second;
+   }
+
+   const T &at(const Key &key) const {
+     Elem *e = findElem(key);
+     if (!e) throw index_out_of_bound();
+     return e->value.second;
+   }
+
+   /**
+  * access specified element
+  * Returns a reference to the value that is mapped to a key equivalent to key,
+  *   performing an insertion if such key does not already exist.
+    */
+   T &operator[](const Key &key) { return emplaceKey(key, key, T()).first->value.second; }
+
+   /**
+  * behave like at() throw index_out_of_bound if such key does not exist.
+    */
+   const T &operator[](const Key &key) const { return at(key); }
+
+   iterator begin() { return iterator(firstElem(), this); }
+
+   const_iterator cbegin() const { return const_iterator(firstElem(), this); }
+
+   iterator end() { return iterator(nullptr, this); }
+
+   const_iterator cend() const { return const_iterator(nullptr, this); }
+
+   bool empty() const { return n == 0; }
+
+   size_t size() const { return n; }
+
+   void clear() {
+     if (root) destroy(root);
+     root = nullptr; head = tail = nullptr; n = 0;
+   }
+
+   /**
+  * insert an element.
+  * return a pair, the first of the pair is
+  *   the iterator to the new element (or the element that prevented the insertion),
+  *   the second one is true if insert successfully, or false.
+    */
+   pair<iterator, bool> insert(const value_type &value) {
+     pair<Elem *, bool> r = emplaceKey(value.first, value);
+     return pair<iterator, bool>(iterator(r.first, this), r.second);
+   }
+
+   pair<iterator, bool> insert(value_type &&value) {
+     pair<Elem *, bool> r = emplaceKey(value.first, std::move(value));
+     return pair<iterator, bool>(iterator(r.first, this), r.second);
+   }
+
+   /**
+  * construct value_type from args and insert it; the value is built first,
+  *   then dropped again if its key is already present.
+    */
+   template<class... Args>
+   pair<iterator, bool> emplace(Args &&... args) {
+     Elem *e = createElem(std::forward<Args>(args)...);
+     Leaf *l; int slot;
+     Elem *dup;
+     try {
+       dup = findInsertPos(e->value.first, l, slot);
+       if (!dup) linkElem(e, l, slot);
+     } catch (...) {
+       destroyElem(e);
+       throw;
+     }
+     if (!dup) return pair<iterator, bool>(iterator(e, this), true);
+     destroyElem(e);
+     return pair<iterator, bool>(iterator(dup, this), false);
+   }
+
+   /**
+  * insert value_type(key, T(args...)) unless key is present; args are
+  *   left untouched when it is.
+    */
+   template<class... Args>
+   pair<iterator, bool> try_emplace(const Key &key, Args &&... args) {
+     pair<Elem *, bool> r = emplaceKey(key, key, T(std::forward<Args>(args)...));
+     return pair<iterator, bool>(iterator(r.first, this), r.second);
+   }
+
+   /**
+  * assign obj to the element with key, or insert value_type(key, obj) if there is none.
+  * the second of the returned pair is true on insertion, false on assignment.
+    */
+   template<class M>
+   pair<iterator, bool> insert_or_assign(const Key &key, M &&obj) {
+     Leaf *l; int slot;
+     Elem *e = findInsertPos(key, l, slot);
+     if (e) {
+       e->value.second = std::forward<M>(obj);
+       return pair<iterator, bool>(iterator(e, this), false);
+     }
+     e = createElem(key, std::forward<M>(obj));
+     try {
+       linkElem(e, l, slot);
+     } catch (...) {
+       destroyElem(e);
+       throw;
+     }
+     return pair<iterator, bool>(iterator(e, this), true);
+   }
+
+   /**
+  * erase the element at pos.
+  *
+  * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
+    */
+   void erase(iterator pos) {
+     if (pos.owner != this || pos.cur == nullptr) throw invalid_iterator();
+     eraseElem(pos.cur);
+   }
+
+   /**
+  * erase [first, last) and return last.
+  * throw invalid_iterator if either iterator belongs to another map.
+    */
+   iterator erase(iterator first, iterator last) {
+     if (first.owner != this || last.owner != this) throw invalid_iterator();
+     while (first.cur != last.cur) {
+       if (!first.cur) throw invalid_iterator();
+       Elem *e = first.cur;
+       first.cur = successor(e);
+       eraseElem(e);
+     }
+     return last;
+   }
+
+   /**
+  * erase the element with key, if any; returns the number erased (0 or 1).
+    */
+   size_t erase(const Key &key) {
+     Elem *e = findElem(key);
+     if (!e) return 0;
+     eraseElem(e);
+     return 1;
+   }
+
+   /**
+  * Returns the number of elements with key
+  *   that compares equivalent to the specified argument,
+  *   which is either 1 or 0
+  *     since this container does not allow duplicates.
+    */
+   size_t count(const Key &key) const { return findElem(key) ? 1 : 0; }
+
+   /**
+  * Finds an element with key equivalent to key.
+  * key value of the element to search for.
+  * Iterator to an element with key equivalent to key.
+  *   If no such element is found, past-the-end (see end()) iterator is returned.
+    */
+   iterator find(const Key &key) { return iterator(findElem(key), this); }
+
+   const_iterator find(const Key &key) const { return const_iterator(findElem(key), this); }
+
+   /**
+  * first element whose key is not less than key, or end().
+    */
+   iterator lower_bound(const Key &key) { return iterator(lowerElem(key), this); }
+   const_iterator lower_bound(const Key &key) const { return const_iterator(lowerElem(key), this); }
+
+   /**
+  * first element whose key is greater than key, or end().
+    */
+   iterator upper_bound(const Key &key) { return iterator(upperElem(key), this); }
+   const_iterator upper_bound(const Key &key) const { return const_iterator(upperElem(key), this); }
+
+   /**
+  * [lower_bound(key), upper_bound(key)): empty or the one element with key.
+    */
+   pair<iterator, iterator> equal_range(const Key &key) {
+     Elem *lo = lowerElem(key);
+     Elem *hi = lo && !comp(key, lo->value.first) ? successor(lo) : lo;
+     return pair<iterator, iterator>(iterator(lo, this), iterator(hi, this));
+   }
+   pair<const_iterator, const_iterator> equal_range(const Key &key) const {
+     Elem *lo = lowerElem(key);
+     Elem *hi = lo && !comp(key, lo->value.first) ? successor(lo) : lo;
+     return pair<const_iterator, const_iterator>(const_iterator(lo, this), const_iterator(hi, this));
+   }
+
+   /**
+  * heterogeneous lookup with a transparent Compare, as in sjtu::map.
+    */
+   template<class K>
+   typename detail::if_transparent<Compare, K, T &>::type at(const K &key) {
+     Elem *e = findElem(key);
+     if (!e) throw index_out_of_bound();
+     return e->value.second;
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, const T &>::type at(const K &key) const {
+     Elem *e = findElem(key);
+     if (!e) throw index_out_of_bound();
+     return e->value.second;
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, size_t>::type count(const K &key) const { return findElem(key) ? 1 : 0; }
+   template<class K>
+   typename detail::if_transparent<Compare, K, iterator>::type find(const K &key) { return iterator(findElem(key), this); }
+   template<class K>
+   typename detail::if_transparent<Compare, K, const_iterator>::type find(const K &key) const {
+     return const_iterator(findElem(key), this);
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, iterator>::type lower_bound(const K &key) { return iterator(lowerElem(key), this); }
+   template<class K>
+   typename detail::if_transparent<Compare, K, const_iterator>::type lower_bound(const K &key) const {
+     return const_iterator(lowerElem(key), this);
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, iterator>::type upper_bound(const K &key) { return iterator(upperElem(key), this); }
+   template<class K>
+   typename detail::if_transparent<Compare, K, const_iterator>::type upper_bound(const K &key) const {
+     return const_iterator(upperElem(key), this);
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, pair<iterator, iterator> >::type equal_range(const K &key) {
+     Elem *lo = lowerElem(key);
+     Elem *hi = lo && !comp(key, lo->value.first) ? successor(lo) : lo;
+     return pair<iterator, iterator>(iterator(lo, this), iterator(hi, this));
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, pair<const_iterator, const_iterator> >::type equal_range(const K &key) const {
+     Elem *lo = lowerElem(key);
+     Elem *hi = lo && !comp(key, lo->value.first) ? successor(lo) : lo;
+     return pair<const_iterator, const_iterator>(const_iterator(lo, this), const_iterator(hi, this));
+   }
+};
+
+/**
+ * sjtu::map with the B+-tree layout: same interface, same iterator and
+ *   exception behaviour as the node-based map.
+ * the node-based extras (split/join/merge, order statistics) are not provided.
+ */
+template<class Key, class T, class Compare, class Allocator, size_t NodeBytes>
+class map<Key, T, Compare, Allocator, btree_layout<NodeBytes> >
+    : public btree_map<Key, T, Compare, Allocator, NodeBytes> {
+   typedef btree_map<Key, T, Compare, Allocator, NodeBytes> base;
+  public:
+   map() {}
+
+   template<class InputIt>
+   map(InputIt first, InputIt last) : base(first, last) {}
+};
+
+}
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * vector compares for searching inside btree_map nodes.
+ *
+ * simd_count<T>::count<Eq>(keys, cnt, key) returns how many of keys[0, cnt)
+ * are less than key (Eq: not greater than key). it compares the probe against
+ * a whole node's keys with SSE2/AVX2 on x86 or NEON on AArch64 and adds up the
+ * lane masks, so a node search has no data-dependent branch.
+ *
+ * specialised for int, unsigned, long, unsigned long, long long, unsigned long
+ * long, float and double; enabled is false for every other type, and for all
+ * of them on targets without vector support or with SJTU_NO_SIMD defined.
+ * NaN keys are not ordered by std::less and are not supported.
+ */
+#ifndef SJTU_BTREE_SIMD_HPP
+#define SJTU_BTREE_SIMD_HPP
+
+#include <cstddef>
+
+#if !defined(SJTU_NO_SIMD)
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define SJTU_SIMD_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SJTU_SIMD_NEON 1
+#endif
+#endif
+
+namespace sjtu {
+
+namespace detail {
+
+template<class T> struct simd_count { static const bool enabled = false; };
+
+#if defined(SJTU_SIMD_X86) || defined(SJTU_SIMD_NEON)
+
+// the tail after the last full vector; branch free as well
+template<bool Eq, class T>
+inline int scalar_count(const T *keys, int from, int cnt, T key) {
+  int c = 0;
+  for (int i = from; i < cnt; ++i) c += Eq ? !(key < keys[i]) : keys[i] < key;
+  return c;
+}
+
+// 32-bit integers. the compares are signed, so unsigned keys get their top bit
+// flipped first, which maps unsigned order onto signed order.
+template<class T, bool Unsigned>
+struct simd_i32 {
+  static_assert(sizeof(T) == 4, "simd_i32 needs 32-bit keys");
+  static const bool enabled = true;
+  template<bool Eq>
+  static int count(const T *keys, int cnt, T key) {
+    int c = 0, i = 0;
+#if defined(SJTU_SIMD_X86)
+#if defined(__AVX2__)
+    const __m256i bias8 = _mm256_set1_epi32(Unsigned ? static_cast<int>(0x80000000u) : 0);
+    const __m256i k8 = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(key)), bias8);
+    for (; i + 8 <= cnt; i += 8) {
+      __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)), bias8);
+      int m = _mm256_movemask_ps(_mm256_castsi256_ps(Eq ? _mm256_cmpgt_epi32(v, k8) : _mm256_cmpgt_epi32(k8, v)));
+      c += Eq ? 8 - __builtin_popcount(m) : __builtin_popcount(m);
+    }
+#endif
+    const __m128i bias = _mm_set1_epi32(Unsigned ? static_cast<int>(0x80000000u) : 0);
+    const __m128i k = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(key)), bias);
+    for (; i + 4 <= cnt; i += 4) {
+      __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i)), bias);
+      int m = _mm_movemask_ps(_mm_castsi128_ps(Eq ? _mm_cmpgt_epi32(v, k) : _mm_cmpgt_epi32(k, v)));
+      c += Eq ? 4 - __builtin_popcount(m) : __builtin_popcount(m);
+    }
+#else
+    const uint32x4_t bias = vdupq_n_u32(Unsigned ? 0x80000000u : 0);
+    const int32x4_t k = vreinterpretq_s32_u32(veorq_u32(vdupq_n_u32(static_cast<uint32_t>(key)), bias));
+    for (; i + 4 <= cnt; i += 4) {
+      int32x4_t v = vreinterpretq_s32_u32(veorq_u32(vld1q_u32(reinterpret_cast<const uint32_t *>(keys + i)), bias));
+      uint32x4_t m = Eq ? vcleq_s32(v, k) : vcltq_s32(v, k);
+      c += static_cast<int>(vaddvq_u32(vshrq_n_u32(m, 31)));
+    }
+#endif
+    return c + scalar_count<Eq>(keys, i, cnt, key);
+  }
+};
+
+// 64-bit integers; x86 needs SSE4.2 for the 64-bit compare, below that the
+// scalar loop does all the work
+template<class T, bool Unsigned>
+struct simd_i64 {
+  static_assert(sizeof(T) == 8, "simd_i64 needs 64-bit keys");
+  static const bool enabled = true;
+  template<bool Eq>
+  static int count(const T *keys, int cnt, T key) {
+    int c = 0, i = 0;
+#if defined(SJTU_SIMD_X86) && defined(__AVX2__)
+    const __m256i bias = _mm256_set1_epi64x(Unsigned ? static_cast<long long>(0x8000000000000000ull) : 0);
+    const __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(key)), bias);
+    for (; i + 4 <= cnt; i += 4) {
+      __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)), bias);
+      int m = _mm256_movemask_pd(_mm256_castsi256_pd(Eq ? _mm256_cmpgt_epi64(v, k) : _mm256_cmpgt_epi64(k, v)));
+      c += Eq ? 4 - __builtin_popcount(m) : __builtin_popcount(m);
+    }
+#elif defined(SJTU_SIMD_X86) && defined(__SSE4_2__)
+    const __m128i bias = _mm_set1_epi64x(Unsigned ? static_cast<long long>(0x8000000000000000ull) : 0);
+    const __m128i k = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(key)), bias);
+    for (; i + 2 <= cnt; i += 2) {
+      __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i)), bias);
+      int m = _mm_movemask_pd(_mm_castsi128_pd(Eq ? _mm_cmpgt_epi64(v, k) : _mm_cmpgt_epi64(k, v)));
+      c += Eq ? 2 - __builtin_popcount(m) : __builtin_popcount(m);
+    }
+#elif defined(SJTU_SIMD_NEON)
+    const uint64x2_t bias = vdupq_n_u64(Unsigned ? 0x8000000000000000ull : 0);
+    const int64x2_t k = vreinterpretq_s64_u64(veorq_u64(vdupq_n_u64(static_cast<uint64_t>(key)), bias));
+    for (; i + 2 <= cnt; i += 2) {
+      int64x2_t v = vreinterpretq_s64_u64(veorq_u64(vld1q_u64(reinterpret_cast<const uint64_t *>(keys + i)), bias));
+      uint64x2_t m = Eq ? vcleq_s64(v, k) : vcltq_s64(v, k);
+      c += static_cast<int>(vaddvq_u64(vshrq_n_u64(m, 63)));
+    }
+#endif
+    return c + scalar_count<Eq>(keys, i, cnt, key);
+  }
+};
+
+template<class T, bool Unsigned, size_t Bytes = sizeof(T)> struct simd_int {};
+template<class T, bool Unsigned> struct simd_int<T, Unsigned, 4> : simd_i32<T, Unsigned> {};
+template<class T, bool Unsigned> struct simd_int<T, Unsigned, 8> : simd_i64<T, Unsigned> {};
+
+struct simd_f32 {
+  static const bool enabled = true;
+  template<bool Eq>
+  static int count(const float *keys, int cnt, float key) {
+    int c = 0, i = 0;
+#if defined(SJTU_SIMD_X86)
+#if defined(__AVX__)
+    const __m256 k8 = _mm256_set1_ps(key);
+    for (; i + 8 <= cnt; i += 8)
+      c += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(keys + i), k8, Eq ? _CMP_LE_OQ : _CMP_LT_OQ)));
+#endif
+    const __m128 k = _mm_set1_ps(key);
+    for (; i + 4 <= cnt; i += 4) {
+      __m128 v = _mm_loadu_ps(keys + i);
+      c += __builtin_popcount(_mm_movemask_ps(Eq ? _mm_cmple_ps(v, k) : _mm_cmplt_ps(v, k)));
+    }
+#else
+    const float32x4_t k = vdupq_n_f32(key);
+    for (; i + 4 <= cnt; i += 4) {
+      float32x4_t v = vld1q_f32(keys + i);
+      uint32x4_t m = Eq ? vcleq_f32(v, k) : vcltq_f32(v, k);
+      c += static_cast<int>(vaddvq_u32(vshrq_n_u32(m, 31)));
+    }
+#endif
+    return c + scalar_count<Eq>(keys, i, cnt, key);
+  }
+};
+
+struct simd_f64 {
+  static const bool enabled = true;
+  template<bool Eq>
+  static int count(const double *keys, int cnt, double key) {
+    int c = 0, i = 0;
+#if defined(SJTU_SIMD_X86)
+#if defined(__AVX__)
+    const __m256d k4 = _mm256_set1_pd(key);
+    for (; i + 4 <= cnt; i += 4)
+      c += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(keys + i), k4, Eq ? _CMP_LE_OQ : _CMP_LT_OQ)));
+#endif
+    const __m128d k = _mm_set1_pd(key);
+    for (; i + 2 <= cnt; i += 2) {
+      __m128d v = _mm_loadu_pd(keys + i);
+      c += __builtin_popcount(_mm_movemask_pd(Eq ? _mm_cmple_pd(v, k) : _mm_cmplt_pd(v, k)));
+    }
+#else
+    const float64x2_t k = vdupq_n_f64(key);
+    for (; i + 2 <= cnt; i += 2) {
+      float64x2_t v = vld1q_f64(keys + i);
+      uint64x2_t m = Eq ? vcleq_f64(v, k) : vcltq_f64(v, k);
+      c += static_cast<int>(vaddvq_u64(vshrq_n_u64(m, 63)));
+    }
+#endif
+    return c + scalar_count<Eq>(keys, i, cnt, key);
+  }
+};
+
+template<> struct simd_count<int> : simd_int<int, false> {};
+template<> struct simd_count<unsigned> : simd_int<unsigned, true> {};
+template<> struct simd_count<long> : simd_int<long, false> {};
+template<> struct simd_count<unsigned long> : simd_int<unsigned long, true> {};
+template<> struct simd_count<long long> : simd_int<long long, false> {};
+template<> struct simd_count<unsigned long long> : simd_int<unsigned long long, true> {};
+template<> struct simd_count<float> : simd_f32 {};
+template<> struct simd_count<double> : simd_f64 {};
+
+#endif
+
+}
+
+}
+
+#endif
@@ -0,0 +1,574 @@
+/**
+ * a map shared by many reader threads and updated by one writer at a time.
+ *
+ * nodes are immutable once published. a write copies the O(log n) nodes on
+ * the path it changes, links the copies to the untouched subtrees and
+ * publishes the new root with one atomic store, so a reader only ever sees
+ * complete versions and never takes a lock: it announces itself in a
+ * per-thread epoch slot, loads the root and searches or iterates as in any
+ * binary tree. writers are serialised by a mutex inside the map.
+ *
+ * the replaced nodes are freed by the writer once no reader that might
+ * still see them is left (epoch-based reclamation): every reader section
+ * records the global epoch it started in, and a batch retired in epoch e is
+ * freed after all running sections started later than e. a reader that
+ * stays inside one snapshot for long holds back the garbage of every map.
+ *
+ * nodes hold their value by value, so value_type must be copy-constructible;
+ * a write copies the values of the nodes on its path.
+ *
+ * not part of the OJ submission; map.hpp does not depend on this file.
+ */
+#ifndef SJTU_CONCURRENT_MAP_HPP
+#define SJTU_CONCURRENT_MAP_HPP
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include "map.hpp"
+
+namespace sjtu {
+
+namespace detail {
+
+// one reader thread's announcement: the epoch its current section started
+// in, 0 when outside. on a cache line of its own so readers never share one.
+struct alignas(64) epoch_record {
+   std::atomic<unsigned long long> active{0};
+   std::atomic<bool> taken{true};
+   epoch_record *next = nullptr;
+   unsigned depth = 0;  // nesting of the owner's sections, only it touches this
+};
+
+// the global epoch and every thread's record. records are never freed; a
+// thread that exits hands its record to the next thread that starts reading.
+class epoch_domain {
+  private:
+   std::atomic<unsigned long long> epoch{1};
+   std::atomic<epoch_record *> records{nullptr};
+
+  public:
+   static epoch_domain &global() {
+     static epoch_domain d;
+     return d;
+   }
+
+   epoch_record *acquire() {
+     for (epoch_record *r = records.load(std::memory_order_acquire); r; r = r->next) {
+       bool expected = false;
+       if (!r->taken.load(std::memory_order_relaxed) && r->taken.compare_exchange_strong(expected, true)) return r;
+     }
+     // plain new only guarantees alignof(max_align_t) before C++17
+     void *raw;
+     if (posix_memalign(&raw, alignof(epoch_record), sizeof(epoch_record))) throw std::bad_alloc();
+     epoch_record *r = new (raw) epoch_record;
+     r->next = records.load(std::memory_order_relaxed);
+     while (!records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {}
+     return r;
+   }
+   void release(epoch_record *r) { r->taken.store(false, std::memory_order_release); }
+
+   unsigned long long current() const { return epoch.load(std::memory_order_seq_cst); }
+   void advance() { epoch.fetch_add(1, std::memory_order_seq_cst); }
+
+   // the oldest epoch a running section started in; ~0 when nobody reads
+   unsigned long long oldest() const {
+     unsigned long long m = ~0ull;
+     for (epoch_record *r = records.load(std::memory_order_acquire); r; r = r->next) {
+       unsigned long long e = r->active.load(std::memory_order_seq_cst);
+       if (e && e < m) m = e;
+     }
+     return m;
+   }
+};
+
+struct epoch_owner {
+   epoch_record *rec;
+   epoch_owner() : rec(epoch_domain::global().acquire()) {}
+   ~epoch_owner() { epoch_domain::global().release(rec); }
+};
+
+inline epoch_record &local_epoch() {
+  static thread_local epoch_owner owner;
+  return *owner.rec;
+}
+
+// a reader section on the calling thread; sections nest
+class epoch_guard {
+  private:
+   epoch_record *rec;
+
+  public:
+   epoch_guard() : rec(&local_epoch()) {
+     if (rec->depth++ == 0) rec->active.store(epoch_domain::global().current(), std::memory_order_seq_cst);
+   }
+   epoch_guard(const epoch_guard &other) : rec(other.rec) { ++rec->depth; }
+   epoch_guard &operator=(const epoch_guard &) = delete;
+   ~epoch_guard() {
+     if (--rec->depth == 0) rec->active.store(0, std::memory_order_release);
+   }
+};
+
+}
+
+/**
+ * Compare and the key/value types follow sjtu::map. all member functions
+ * may be called from any thread at the same time; see snapshot for the
+ * lock-free read side.
+ */
+template<class Key, class T, class Compare = std::less<Key> >
+class concurrent_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+  private:
+   struct Node {
+     value_type value;
+     Node *left;
+     Node *right;
+     Node *chain = nullptr;  // writer only: the fresh / replaced / retired lists
+     int height = 1;
+     bool fresh = true;      // created by the running write, not published yet
+     template<class... Args>
+     Node(Node *l, Node *r, Args &&... args) : value(std::forward<Args>(args)...), left(l), right(r) {}
+   };
+
+   // nodes retired up to one epoch, freed once every reader is past it
+   struct Batch {
+     unsigned long long epoch = 0;
+     Node *nodes = nullptr;
+     Batch *next = nullptr;
+   };
+
+   // AVL height bound for any tree that fits in memory (2^44 nodes need < 64)
+   static const int maxHeight = 64;
+   static const size_t batchNodes = 128;
+
+   std::atomic<Node *> root{nullptr};
+   std::atomic<size_t> n{0};
+   Compare comp = Compare();
+
+   // everything below belongs to the writer holding lock
+   std::mutex lock;
+   pool_allocator<Node> alloc;
+   Node *fresh = nullptr;     // created by the running write
+   Node *replaced = nullptr;  // unlinked by the running write
+   Node *pending = nullptr;   // retired, waiting for the next epoch
+   size_t pendingCount = 0;
+   Batch *oldest = nullptr, *newest = nullptr;
+   Batch *spare = nullptr;    // allocated before a write so sealing never throws
+
+   static int height(Node *x) { return x ? x->height : 0; }
+
+   template<class... Args>
+   Node *make(Node *l, Node *r, Args &&... args) {
+     Node *x = alloc.allocate(1);
+     try {
+       new (x) Node(l, r, std::forward<Args>(args)...);
+     } catch (...) {
+       alloc.deallocate(x, 1);
+       throw;
+     }
+     x->height = 1 + (height(l) > height(r) ? height(l) : height(r));
+     x->chain = fresh;
+     fresh = x;
+     return x;
+   }
+
+   void freeNode(Node *x) {
+     x->~Node();
+     alloc.deallocate(x, 1);
+   }
+
+   // src with children l and r: src itself while it is still private to this
+   // write, otherwise a copy, and src goes on the replaced list
+   Node *rebuild(Node *src, Node *l, Node *r) {
+     if (!src->fresh) {
+       Node *x = make(l, r, src->value);
+       src->chain = replaced;
+       replaced = src;
+       return x;
+     }
+     src->left = l; src->right = r;
+     src->height = 1 + (height(l) > height(r) ? height(l) : height(r));
+     return src;
+   }
+
+   // rebuild src over l and r, rotating when their heights differ by two
+   Node *balance(Node *src, Node *l, Node *r) {
+     int hl = height(l), hr = height(r);
+     if (hl > hr + 1) {
+       if (height(l->left) >= height(l->right)) {
+         Node *down = rebuild(src, l->right, r);
+         return rebuild(l, l->left, down);
+       }
+       Node *lr = l->right;
+       Node *a = rebuild(l, l->left, lr->left);
+       Node *b = rebuild(src, lr->right, r);
+       return rebuild(lr, a, b);
+     }
+     if (hr > hl + 1) {
+       if (height(r->right) >= height(r->left)) {
+         Node *down = rebuild(src, l, r->left);
+         return rebuild(r, down, r->right);
+       }
+       Node *rl = r->left;
+       Node *a = rebuild(src, l, rl->left);
+       Node *b = rebuild(r, rl->right, r->right);
+       return rebuild(rl, a, b);
+     }
+     return rebuild(src, l, r);
+   }
+
+   // the new version of subtree x with key set; x itself when nothing changed.
+   // Assign: an existing key gets value_type(key, args...) too.
+   template<bool Assign, class... Args>
+   Node *insertAt(Node *x, const Key &key, bool &inserted, Args &&... args) {
+     if (!x) {
+       inserted = true;
+       return make(nullptr, nullptr, std::forward<Args>(args)...);
+     }
+     if (comp(key, x->value.first)) {
+       Node *l = insertAt<Assign>(x->left, key, inserted, std::forward<Args>(args)...);
+       return l == x->left ? x : balance(x, l, x->right);
+     }
+     if (comp(x->value.first, key)) {
+       Node *r = insertAt<Assign>(x->right, key, inserted, std::forward<Args>(args)...);
+       return r == x->right ? x : balance(x, x->left, r);
+     }
+     if (!Assign) return x;
+     Node *y = make(x->left, x->right, std::forward<Args>(args)...);
+     x->chain = replaced;
+     replaced = x;
+     return y;
+   }
+
+   // subtree y without its smallest node, which is handed back in m
+   Node *removeMin(Node *y, Node *&m) {
+     if (!y->left) {
+       m = y;
+       y->chain = replaced;
+       replaced = y;
+       return y->right;
+     }
+     Node *l = removeMin(y->left, m);
+     return balance(y, l, y->right);
+   }
+
+   Node *eraseAt(Node *x, const Key &key, bool &erased) {
+     if (!x) return x;
+     if (comp(key, x->value.first)) {
+       Node *l = eraseAt(x->left, key, erased);
+       return erased ? balance(x, l, x->right) : x;
+     }
+     if (comp(x->value.first, key)) {
+       Node *r = eraseAt(x->right, key, erased);
+       return erased ? balance(x, x->left, r) : x;
+     }
+     erased = true;
+     x->chain = replaced;
+     replaced = x;
+     if (!x->left) return x->right;
+     if (!x->right) return x->left;
+     Node *m;
+     Node *r = removeMin(x->right, m);
+     Node *top = make(x->left, r, m->value);
+     return balance(top, top->left, top->right);
+   }
+
+   // before a write: make sure sealing afterwards needs no allocation
+   void prepare() {
+     if (!spare) spare = new Batch;
+   }
+
+   // a write failed half way: nothing was published, drop what it built
+   void rollback() {
+     while (fresh) { Node *x = fresh; fresh = x->chain; freeNode(x); }
+     replaced = nullptr;
+   }
+
+   // a write built top: publish it and retire the nodes it replaced
+   void commit(Node *top) {
+     for (Node *x = fresh; x; x = x->chain) x->fresh = false;
+     fresh = nullptr;
+     root.store(top, std::memory_order_seq_cst);
+     while (replaced) {
+       Node *x = replaced;
+       replaced = x->chain;
+       x->chain = pending;
+       pending = x;
+       ++pendingCount;
+     }
+     if (pendingCount >= batchNodes) seal();
+   }
+
+   // close the pending nodes into a batch of the current epoch, move the
+   // epoch on and free every batch no reader can reach any more
+   void seal() {
+     detail::epoch_domain &d = detail::epoch_domain::global();
+     Batch *b = spare;
+     spare = nullptr;
+     b->epoch = d.current();
+     b->nodes = pending;
+     b->next = nullptr;
+     pending = nullptr;
+     pendingCount = 0;
+     if (newest) newest->next = b;
+     else oldest = b;
+     newest = b;
+     d.advance();
+     unsigned long long safe = d.oldest();
+     while (oldest && oldest->epoch < safe) {
+       Batch *done = oldest;
+       oldest = done->next;
+       if (!oldest) newest = nullptr;
+       while (done->nodes) { Node *x = done->nodes; done->nodes = x->chain; freeNode(x); }
+       if (spare) delete done;
+       else spare = done;
+     }
+   }
+
+   void destroy(Node *x) {
+     if (!x) return;
+     destroy(x->left);
+     destroy(x->right);
+     freeNode(x);
+   }
+
+   // every node of subtree x onto the replaced list
+   void replaceAll(Node *x) {
+     if (!x) return;
+     replaceAll(x->left);
+     replaceAll(x->right);
+     x->chain = replaced;
+     replaced = x;
+   }
+
+   template<bool Assign, class... Args>
+   bool update(const Key &key, Args &&... args) {
+     std::lock_guard<std::mutex> hold(lock);
+     prepare();
+     bool inserted = false;
+     Node *old = root.load(std::memory_order_relaxed), *top;
+     try {
+       top = insertAt<Assign>(old, key, inserted, std::forward<Args>(args)...);
+     } catch (...) {
+       rollback();
+       throw;
+     }
+     if (top != old) commit(top);
+     if (inserted) n.fetch_add(1, std::memory_order_relaxed);
+     return inserted;
+   }
+
+  public:
+   /**
+  * a consistent, read-only view of the map as of its creation, pinned by a
+  * reader section of the calling thread; later writes do not show up in it.
+  * lookups and iteration take no lock and never wait for the writer.
+  * a snapshot and its iterators belong to the thread that made it and must
+  * not outlive the map.
+    */
+   class snapshot {
+     public:
+      /**
+    * forward iterator in key order; keeps the path from the root, so a step
+    * costs O(1) amortized without parent links.
+      */
+      class const_iterator {
+        private:
+         const Node *stack[maxHeight];
+         int depth = 0;
+         friend class snapshot;
+
+         void pushLeft(const Node *x) {
+           for (; x; x = x->left) stack[depth++] = x;
+         }
+
+        public:
+         const_iterator() {}
+         const_iterator(const const_iterator &other) : depth(other.depth) {
+           for (int i = 0; i < depth; ++i) stack[i] = other.stack[i];
+         }
+         const_iterator &operator=(const const_iterator &other) {
+           depth = other.depth;
+           for (int i = 0; i < depth; ++i) stack[i] = other.stack[i];
+           return *this;
+         }
+         /**
+        * throw invalid_iterator if the iterator is already end().
+          */
+         const_iterator &operator++() {
+           if (!depth) throw invalid_iterator();
+           const Node *x = stack[--depth];
+           pushLeft(x->right);
+           return *this;
+         }
+         const_iterator operator++(int) {
+           const_iterator tmp = *this;
+           ++*this;
+           return tmp;
+         }
+         const value_type &operator*() const {
+           if (!depth) throw invalid_iterator();
+           return stack[depth - 1]->value;
+         }
+         const value_type *operator->() const {
+           if (!depth) throw invalid_iterator();
+           return &stack[depth - 1]->value;
+         }
+         bool operator==(const const_iterator &rhs) const {
+           return (depth ? stack[depth - 1] : nullptr) == (rhs.depth ? rhs.stack[rhs.depth - 1] : nullptr);
+         }
+         bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+      };
+
+     private:
+      detail::epoch_guard guard;
+      const Node *top;
+      const Compare *comp;
+
+      // the first node not less than key (Upper: greater than key), with its path
+      template<bool Upper>
+      const_iterator bound(const Key &key) const {
+        const_iterator it;
+        for (const Node *x = top; x;) {
+          if (Upper ? (*comp)(key, x->value.first) : !(*comp)(x->value.first, key)) {
+            it.stack[it.depth++] = x;
+            x = x->left;
+          } else {
+            x = x->right;
+          }
+        }
+        return it;
+      }
+
+     public:
+      // the guard must be in place before the root is read
+      explicit snapshot(const concurrent_map &m) : top(m.root.load(std::memory_order_seq_cst)), comp(&m.comp) {}
+
+      bool empty() const { return !top; }
+
+      const_iterator begin() const {
+        const_iterator it;
+        it.pushLeft(top);
+        return it;
+      }
+      const_iterator cbegin() const { return begin(); }
+      const_iterator end() const { return const_iterator(); }
+      const_iterator cend() const { return end(); }
+
+      const_iterator lower_bound(const Key &key) const { return bound<false>(key); }
+      const_iterator upper_bound(const Key &key) const { return bound<true>(key); }
+
+      /**
+    * the element with this key, or end().
+      */
+      const_iterator find(const Key &key) const {
+        const_iterator it = bound<false>(key);
+        if (it.depth && (*comp)(key, it.stack[it.depth - 1]->value.first)) return end();
+        return it;
+      }
+
+      /**
+    * 1 if the key is in this snapshot, 0 otherwise; no path is kept.
+      */
+      size_t count(const Key &key) const {
+        for (const Node *x = top; x;) {
+          if ((*comp)(key, x->value.first)) x = x->left;
+          else if ((*comp)(x->value.first, key)) x = x->right;
+          else return 1;
+        }
+        return 0;
+      }
+   };
+
+   concurrent_map() {}
+   concurrent_map(const concurrent_map &) = delete;
+   concurrent_map &operator=(const concurrent_map &) = delete;
+
+   /**
+  * no thread may be reading or writing any more.
+    */
+   ~concurrent_map() {
+     destroy(root.load(std::memory_order_relaxed));
+     while (pending) { Node *x = pending; pending = x->chain; freeNode(x); }
+     while (oldest) {
+       Batch *b = oldest;
+       oldest = b->next;
+       while (b->nodes) { Node *x = b->nodes; b->nodes = x->chain; freeNode(x); }
+       delete b;
+     }
+     delete spare;
+   }
+
+   /**
+  * a view of the current version; see snapshot.
+    */
+   snapshot snap() const { return snapshot(*this); }
+
+   /**
+  * lock-free lookups on the current version.
+  * find copies the mapped value into out and tells whether the key was there.
+    */
+   size_t count(const Key &key) const { return snap().count(key); }
+   bool find(const Key &key, T &out) const {
+     snapshot s(*this);
+     typename snapshot::const_iterator it = s.find(key);
+     if (it == s.end()) return false;
+     out = it->second;
+     return true;
+   }
+
+   /**
+  * the number of elements after the last finished write.
+    */
+   size_t size() const { return n.load(std::memory_order_relaxed); }
+   bool empty() const { return size() == 0; }
+
+   /**
+  * insert value if its key is absent; return whether it was inserted.
+  * readers keep seeing the old version until the new root is published.
+    */
+   bool insert(const value_type &value) { return update<false>(value.first, value); }
+
+   /**
+  * insert (key, obj), or replace the mapped value of an existing key.
+  * return true if a new element was inserted.
+    */
+   template<class M>
+   bool insert_or_assign(const Key &key, M &&obj) { return update<true>(key, key, std::forward<M>(obj)); }
+
+   /**
+  * remove the element with this key; return the number removed (0 or 1).
+    */
+   size_t erase(const Key &key) {
+     std::lock_guard<std::mutex> hold(lock);
+     prepare();
+     bool erased = false;
+     Node *old = root.load(std::memory_order_relaxed), *top;
+     try {
+       top = eraseAt(old, key, erased);
+     } catch (...) {
+       rollback();
+       throw;
+     }
+     if (!erased) return 0;
+     commit(top);
+     n.fetch_sub(1, std::memory_order_relaxed);
+     return 1;
+   }
+
+   void clear() {
+     std::lock_guard<std::mutex> hold(lock);
+     prepare();
+     replaceAll(root.load(std::memory_order_relaxed));
+     commit(nullptr);
+     n.store(0, std::memory_order_relaxed);
+   }
+};
+
+}
+
+#endif
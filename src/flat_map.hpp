@@ -0,0 +1,344 @@
+/**
+ * a read-only sorted table with the lookup interface of sjtu::map.
+ *
+ * keys and mapped values sit in two separate arrays in key order, so a search
+ * only touches keys and a scan streams through memory. the table is built
+ * once, normally from an sjtu::map with freeze(), and the keys never change
+ * afterwards; mapped values may still be written through at().
+ *
+ * Eytzinger = true adds a copy of the keys in breadth-first order of the
+ * implicit search tree (plus each one's position), which puts the first
+ * levels of every search in the same cache lines and lets the loop prefetch
+ * the levels ahead: faster lookups on big tables, for one more key array.
+ *
+ * iterators hand out pair<const Key &, const T &> by value, since the table
+ * holds no value_type objects; it->first and it->second work as for the map.
+ *
+ * not part of the OJ submission; map.hpp does not depend on this file.
+ */
+#ifndef SJTU_FLAT_MAP_HPP
+#define SJTU_FLAT_MAP_HPP
+
+#include <new>
+#include "map.hpp"
+
+namespace sjtu {
+
+template<class Key, class T, class Compare = std::less<Key>, bool Eytzinger = false>
+class flat_map {
+  public:
+   typedef pair<const Key, T> value_type;
+   typedef pair<const Key &, const T &> reference;
+
+  private:
+   Key *keys = nullptr;
+   T *vals = nullptr;
+   Key *eyt = nullptr;     // breadth-first order from index 1, only with Eytzinger
+   size_t *rank = nullptr;  // position in keys of each eyt entry
+   size_t n = 0;
+   Compare comp = Compare();
+
+   // keys of one cache line, the distance of the prefetch in the Eytzinger search
+   static const size_t lineKeys = sizeof(Key) < 64 ? 64 / sizeof(Key) : 1;
+
+   template<class U>
+   static U *raw(size_t cnt) { return cnt ? static_cast<U *>(::operator new(cnt * sizeof(U))) : nullptr; }
+
+   template<class U>
+   static void destroyArray(U *p, size_t cnt) {
+     for (size_t i = 0; i < cnt; ++i) p[i].~U();
+     ::operator delete(p);
+   }
+
+   void release() {
+     destroyArray(keys, n);
+     destroyArray(vals, n);
+     if (eyt) {
+       for (size_t k = 1; k <= n; ++k) eyt[k].~Key();
+       ::operator delete(eyt);
+     }
+     ::operator delete(rank);
+     keys = eyt = nullptr;
+     vals = nullptr;
+     rank = nullptr;
+     n = 0;
+   }
+
+   // fill the tree rooted at eytzinger index k with keys[i, ...); returns the next i
+   size_t fill(size_t i, size_t k, size_t &built) {
+     if (k > n) return i;
+     i = fill(i, 2 * k, built);
+     new (eyt + k) Key(keys[i]);
+     ++built;
+     rank[k] = i;
+     return fill(i + 1, 2 * k + 1, built);
+   }
+   // destroy the first cnt entries fill() built, walking the same order
+   void unfill(size_t k, size_t &cnt) {
+     if (k > n || !cnt) return;
+     unfill(2 * k, cnt);
+     if (!cnt) return;
+     eyt[k].~Key();
+     --cnt;
+     unfill(2 * k + 1, cnt);
+   }
+   void index(detail::bool_tag<true>) {
+     if (!n) return;
+     eyt = raw<Key>(n + 1);
+     size_t built = 0;
+     try {
+       rank = raw<size_t>(n + 1);
+       fill(0, 1, built);
+     } catch (...) {
+       unfill(1, built);
+       ::operator delete(rank);
+       ::operator delete(eyt);
+       rank = nullptr;
+       eyt = nullptr;
+       throw;
+     }
+   }
+   void index(detail::bool_tag<false>) {}
+
+   // cnt elements, in key order and with distinct keys, from an input sequence
+   // of pairs
+   template<class It>
+   void build(It first, size_t cnt) {
+     Key *k = raw<Key>(cnt);
+     T *v;
+     try {
+       v = raw<T>(cnt);
+     } catch (...) {
+       ::operator delete(k);
+       throw;
+     }
+     size_t i = 0, j = 0;
+     try {
+       for (; i < cnt; ++i, ++first) {
+         new (k + i) Key((*first).first);
+         new (v + i) T((*first).second);
+         ++j;
+       }
+     } catch (...) {
+       destroyArray(k, i);
+       destroyArray(v, j);
+       throw;
+     }
+     keys = k; vals = v; n = cnt;
+     try {
+       index(detail::bool_tag<Eytzinger>());
+     } catch (...) {
+       release();
+       throw;
+     }
+   }
+
+   // the first position whose key is not less than key (Upper: greater than
+   // key). the sorted search halves the range without branching on the outcome.
+   template<bool Upper>
+   size_t bound(const Key &key, detail::bool_tag<false>) const {
+     if (!n) return 0;
+     const Key *base = keys;
+     size_t len = n;
+     while (len > 1) {
+       size_t half = len >> 1;
+       base = (Upper ? !comp(key, base[half]) : comp(base[half], key)) ? base + half : base;
+       len -= half;
+     }
+     return (base - keys) + (Upper ? !comp(key, *base) : comp(*base, key));
+   }
+   // the Eytzinger search walks down k -> 2k or 2k + 1 and returns the last
+   // node where it turned left (0: none), found by dropping the trailing right
+   // turns. the prefetch fetches the line holding the descendants
+   // log2(lineKeys) levels down; it is only a hint and may point past the end.
+   template<bool Upper>
+   size_t eytBound(const Key &key) const {
+     size_t k = 1;
+     while (k <= n) {
+       detail::prefetch(reinterpret_cast<const void *>(reinterpret_cast<size_t>(eyt) + k * lineKeys * sizeof(Key)));
+       k = 2 * k + (Upper ? !comp(key, eyt[k]) : comp(eyt[k], key));
+     }
+     while (k & 1) k >>= 1;
+     return k >> 1;
+   }
+   template<bool Upper>
+   size_t bound(const Key &key, detail::bool_tag<true>) const {
+     size_t k = eytBound<Upper>(key);
+     return k ? rank[k] : n;
+   }
+   template<bool Upper>
+   size_t bound(const Key &key) const { return bound<Upper>(key, detail::bool_tag<Eytzinger>()); }
+
+   // the Eytzinger copy holds the key the search ends on, no need to load keys[i]
+   size_t findIndex(const Key &key, detail::bool_tag<true>) const {
+     size_t k = eytBound<false>(key);
+     return k && !comp(key, eyt[k]) ? rank[k] : n;
+   }
+   size_t findIndex(const Key &key, detail::bool_tag<false>) const {
+     size_t i = bound<false>(key, detail::bool_tag<false>());
+     return i < n && !comp(key, keys[i]) ? i : n;
+   }
+   size_t findIndex(const Key &key) const { return findIndex(key, detail::bool_tag<Eytzinger>()); }
+
+   bool contains(const Key &key, detail::bool_tag<true>) const {
+     size_t k = eytBound<false>(key);
+     return k && !comp(key, eyt[k]);
+   }
+   bool contains(const Key &key, detail::bool_tag<false>) const { return findIndex(key) < n; }
+
+  public:
+   /**
+  * random access iterator over the table in key order.
+  * throw invalid_iterator when dereferencing end() or stepping out of range.
+    */
+   class const_iterator {
+     private:
+      const flat_map *owner = nullptr;
+      size_t i = 0;
+      friend class flat_map;
+      const_iterator(const flat_map *o, size_t at) : owner(o), i(at) {}
+
+     public:
+      // what operator-> points into
+      struct arrow {
+        reference ref;
+        const reference *operator->() const { return &ref; }
+      };
+
+      const_iterator() {}
+
+      const_iterator &operator++() {
+        if (!owner || i == owner->n) throw invalid_iterator();
+        ++i;
+        return *this;
+      }
+      const_iterator &operator--() {
+        if (!owner || i == 0) throw invalid_iterator();
+        --i;
+        return *this;
+      }
+      const_iterator operator++(int) {
+        const_iterator tmp = *this;
+        ++*this;
+        return tmp;
+      }
+      const_iterator operator--(int) {
+        const_iterator tmp = *this;
+        --*this;
+        return tmp;
+      }
+      const_iterator operator+(long d) const {
+        if (!owner || (d < 0 ? i < size_t(-d) : owner->n - i < size_t(d))) throw invalid_iterator();
+        return const_iterator(owner, i + d);
+      }
+      const_iterator operator-(long d) const { return *this + -d; }
+      long operator-(const const_iterator &rhs) const {
+        if (owner != rhs.owner) throw invalid_iterator();
+        return long(i) - long(rhs.i);
+      }
+
+      reference operator*() const {
+        if (!owner || i == owner->n) throw invalid_iterator();
+        return reference(owner->keys[i], owner->vals[i]);
+      }
+      arrow operator->() const { return arrow{**this}; }
+
+      bool operator==(const const_iterator &rhs) const { return owner == rhs.owner && i == rhs.i; }
+      bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+      bool operator<(const const_iterator &rhs) const { return i < rhs.i; }
+   };
+
+   flat_map() {}
+
+   /**
+  * an O(n) copy of m's elements, see also freeze().
+    */
+   template<class Alloc, class Policy>
+   explicit flat_map(const map<Key, T, Compare, Alloc, Policy> &m) {
+     build(m.cbegin(), m.size());
+   }
+
+   flat_map(const flat_map &other) : comp(other.comp) { build(other.begin(), other.n); }
+
+   flat_map(flat_map &&other)
+     : keys(other.keys), vals(other.vals), eyt(other.eyt), rank(other.rank), n(other.n), comp(other.comp) {
+     other.keys = other.eyt = nullptr;
+     other.vals = nullptr;
+     other.rank = nullptr;
+     other.n = 0;
+   }
+
+   flat_map &operator=(const flat_map &other) {
+     if (this == &other) return *this;
+     flat_map tmp(other);
+     *this = std::move(tmp);
+     return *this;
+   }
+
+   flat_map &operator=(flat_map &&other) {
+     if (this == &other) return *this;
+     release();
+     keys = other.keys; vals = other.vals; eyt = other.eyt; rank = other.rank; n = other.n;
+     comp = other.comp;
+     other.keys = other.eyt = nullptr;
+     other.vals = nullptr;
+     other.rank = nullptr;
+     other.n = 0;
+     return *this;
+   }
+
+   ~flat_map() { release(); }
+
+   /**
+  * access the mapped value of key; the keys are fixed, the values may be changed.
+  * throw index_out_of_bound if the key is absent.
+    */
+   T &at(const Key &key) {
+     size_t i = findIndex(key);
+     if (i == n) throw index_out_of_bound();
+     return vals[i];
+   }
+   const T &at(const Key &key) const {
+     size_t i = findIndex(key);
+     if (i == n) throw index_out_of_bound();
+     return vals[i];
+   }
+
+   /**
+  * behave like at() throw index_out_of_bound if such key does not exist.
+    */
+   const T &operator[](const Key &key) const { return at(key); }
+
+   const_iterator begin() const { return const_iterator(this, 0); }
+   const_iterator cbegin() const { return begin(); }
+   const_iterator end() const { return const_iterator(this, n); }
+   const_iterator cend() const { return end(); }
+
+   bool empty() const { return n == 0; }
+   size_t size() const { return n; }
+
+   size_t count(const Key &key) const { return contains(key, detail::bool_tag<Eytzinger>()) ? 1 : 0; }
+
+   /**
+  * the element with this key, or end().
+    */
+   const_iterator find(const Key &key) const { return const_iterator(this, findIndex(key)); }
+
+   const_iterator lower_bound(const Key &key) const { return const_iterator(this, bound<false>(key)); }
+   const_iterator upper_bound(const Key &key) const { return const_iterator(this, bound<true>(key)); }
+   pair<const_iterator, const_iterator> equal_range(const Key &key) const {
+     return pair<const_iterator, const_iterator>(lower_bound(key), upper_bound(key));
+   }
+};
+
+/**
+ * the elements of m as a flat_map, in O(n); m is left as it is.
+ */
+template<bool Eytzinger = false, class Key, class T, class Compare, class Alloc, class Policy>
+flat_map<Key, T, Compare, Eytzinger> freeze(const map<Key, T, Compare, Alloc, Policy> &m) {
+  return flat_map<Key, T, Compare, Eytzinger>(m);
+}
+
+}
+
+#endif
@@ -7,16 +7,490 @@
 // only for std::less<T>
 #include <functional>
 #include <cstddef>
+#include <string>
 #include "utility.hpp"
 #include "exceptions.hpp"
 
 namespace sjtu {
 
+/**
+ * a pooled allocator for tree nodes.
+ * objects are carved from large chunks and recycled through an intrusive
+ * free list, so allocate(1)/deallocate(p, 1) never reach the global heap in
+ * steady state.
+ * copies share one arena, so memory from one copy may be freed through
+ * another; merge() fuses the arenas of two pools the same way. an arena is
+ * not synchronized: pools sharing one must stay on one thread at a time.
+ * release() hands every chunk back at once; it must only be called once no
+ * object from the arena is alive any more (see unique()).
+ */
+template<class T>
+class pool_allocator {
+  public:
+   typedef T value_type;
+
+  private:
+   union Slot {
+     Slot *next;
+     alignas(T) unsigned char storage[sizeof(T)];
+   };
+   struct Chunk {
+     Chunk *next;
+     size_t cap;
+   };
+
+   static const size_t minSlots = 32;
+   static const size_t maxChunkBytes = 1 << 20;
+
+   struct Arena {
+     Arena *forward = nullptr;  // set once merged into another arena
+     size_t refs = 1;
+     Chunk *chunks = nullptr;
+     Slot *freeList = nullptr;
+     Slot *cursor = nullptr;  // bump pointer inside the newest chunk
+     Slot *limit = nullptr;
+     size_t nextSlots = minSlots;
+     size_t bytes = 0;  // taken from the global heap
+     size_t used = 0;   // slots handed out and not given back
+   };
+
+   mutable Arena *arena = nullptr;
+
+   static size_t header() { return (sizeof(Chunk) + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot); }
+   static Slot *slots(Chunk *c) { return reinterpret_cast<Slot *>(reinterpret_cast<unsigned char *>(c) + header()); }
+
+   static void freeChunks(Arena *a) {
+     while (a->chunks) {
+       Chunk *c = a->chunks;
+       a->chunks = c->next;
+       ::operator delete(c);
+     }
+     a->freeList = a->cursor = a->limit = nullptr;
+     a->nextSlots = minSlots;
+     a->bytes = a->used = 0;
+   }
+   static void drop(Arena *a) {
+     while (a && --a->refs == 0) {
+       Arena *next = a->forward;
+       if (!next) freeChunks(a);
+       delete a;
+       a = next;
+     }
+   }
+
+   // the arena this pool really uses, following merges
+   Arena *live() const {
+     if (!arena) arena = new Arena;
+     while (arena->forward) {
+       Arena *next = arena->forward;
+       ++next->refs;
+       drop(arena);
+       arena = next;
+     }
+     return arena;
+   }
+
+   static void grow(Arena *a, size_t need) {
+     size_t cap = a->nextSlots > need ? a->nextSlots : need;
+     Chunk *c = static_cast<Chunk *>(::operator new(header() + cap * sizeof(Slot)));
+     c->next = a->chunks; c->cap = cap;
+     a->chunks = c;
+     a->bytes += header() + cap * sizeof(Slot);
+     // whatever is left of the old chunk goes to the free list instead of being lost
+     while (a->cursor != a->limit) { a->cursor->next = a->freeList; a->freeList = a->cursor; ++a->cursor; }
+     a->cursor = slots(c); a->limit = a->cursor + cap;
+     if (a->nextSlots * 2 * sizeof(Slot) <= maxChunkBytes) a->nextSlots *= 2;
+   }
+
+  public:
+   template<class U> struct rebind { typedef pool_allocator<U> other; };
+
+   pool_allocator() {}
+   pool_allocator(const pool_allocator &other) : arena(other.live()) { ++arena->refs; }
+   template<class U>
+   pool_allocator(const pool_allocator<U> &) {}
+   pool_allocator &operator=(const pool_allocator &other) {
+     Arena *a = other.live();
+     ++a->refs;
+     drop(arena);
+     arena = a;
+     return *this;
+   }
+   ~pool_allocator() { drop(arena); }
+
+   /**
+    * n == 1 is served from the free list; larger requests get a
+    * contiguous run of slots.
+    */
+   T *allocate(size_t cnt = 1) {
+     Arena *a = live();
+     if (cnt == 1 && a->freeList) {
+       Slot *s = a->freeList;
+       a->freeList = s->next;
+       ++a->used;
+       return reinterpret_cast<T *>(s);
+     }
+     if (size_t(a->limit - a->cursor) < cnt) grow(a, cnt);
+     Slot *s = a->cursor;
+     a->cursor += cnt;
+     a->used += cnt;
+     return reinterpret_cast<T *>(s);
+   }
+
+   void deallocate(T *p, size_t cnt = 1) {
+     Arena *a = live();
+     Slot *s = reinterpret_cast<Slot *>(p);
+     for (size_t i = 0; i < cnt; ++i) { s[i].next = a->freeList; a->freeList = s + i; }
+     a->used -= cnt;
+   }
+
+   /**
+    * bytes the arena holds from the global heap, chunk headers included,
+    * and the bytes of the objects currently allocated from it.
+    */
+   size_t reserved_bytes() const { return live()->bytes; }
+   size_t used_bytes() const { return live()->used * sizeof(T); }
+
+   /**
+    * is this the only pool using its arena?
+    */
+   bool unique() const { return live()->refs == 1; }
+
+   /**
+    * give every chunk of the arena back to the global heap at once.
+    */
+   void release() { freeChunks(live()); }
+
+   /**
+    * make this pool and other use one arena from now on, so objects
+    * allocated by either may be freed through either. costs O(chunks +
+    * free slots) of other's arena; no object moves.
+    */
+   void merge(pool_allocator &other) {
+     Arena *a = live(), *b = other.live();
+     if (a == b) return;
+     if (b->chunks) {
+       Chunk *tail = b->chunks;
+       while (tail->next) tail = tail->next;
+       tail->next = a->chunks;
+       a->chunks = b->chunks;
+     }
+     while (b->cursor != b->limit) { b->cursor->next = a->freeList; a->freeList = b->cursor; ++b->cursor; }
+     while (b->freeList) { Slot *s = b->freeList; b->freeList = s->next; s->next = a->freeList; a->freeList = s; }
+     a->bytes += b->bytes; a->used += b->used;
+     b->bytes = b->used = 0;
+     b->chunks = nullptr;
+     b->forward = a;
+     ++a->refs;
+   }
+
+   bool operator==(const pool_allocator &rhs) const { return live() == rhs.live(); }
+   bool operator!=(const pool_allocator &rhs) const { return live() != rhs.live(); }
+};
+
+namespace detail {
+
+// Alloc<T> -> Alloc<U>; works for any single-parameter allocator template
+template<class Alloc, class U> struct rebind_alloc;
+template<template<class> class Alloc, class T, class U>
+struct rebind_alloc<Alloc<T>, U> { typedef Alloc<U> type; };
+
+template<bool B> struct bool_tag {};
+
+// a read hint for the cache; a no-op where the compiler has no builtin for it
+inline void prefetch(const void *p) {
+#if defined(__GNUC__)
+  __builtin_prefetch(p);
+#else
+  (void)p;
+#endif
+}
+
+// call a scan visitor on v; it may return bool (false: stop) or nothing (go on)
+template<class F, class V>
+auto visit(F &f, V &v, int) -> decltype(bool(f(v))) { return bool(f(v)); }
+template<class F, class V>
+bool visit(F &f, V &v, long) { f(v); return true; }
+
+// a raw timestamp counter for the Timed policy; 0 where there is none
+inline unsigned long long cycles() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  return __builtin_ia32_rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+  unsigned long long t;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+#else
+  return 0;
+#endif
+}
+
+// R, but only when Compare declares is_transparent; K keeps the test dependent
+template<class...> struct voider { typedef void type; };
+template<class Compare, class K, class R, class = void> struct if_transparent {};
+template<class Compare, class K, class R>
+struct if_transparent<Compare, K, R, typename voider<typename Compare::is_transparent, K>::type> { typedef R type; };
+
+// pool_allocator may hand out a block of n and take it back one slot at a time;
+// it can also drop a whole arena at once and fuse the arenas of two pools
+template<class Alloc> struct is_pool { static const bool value = false; };
+template<class T> struct is_pool<pool_allocator<T> > { static const bool value = true; };
+
+// in-order neighbour links, only present in threaded nodes
+template<class Node, bool Threaded> struct thread_links {};
+template<class Node>
+struct thread_links<Node, true> {
+   Node *prev = nullptr;
+   Node *next = nullptr;
+};
+
+// number of nodes in the subtree, only present in sized nodes
+template<bool Sized> struct subtree_size {};
+template<>
+struct subtree_size<true> {
+   size_t size = 1;
+};
+
+// parent link and AVL balance factor (h(left) - h(right), in [-1, 1])
+template<class Node, bool Packed> struct avl_link {
+   Node *up = nullptr;
+   signed char balance = 0;
+   Node *parent() const { return up; }
+   void setParent(Node *p) { up = p; }
+   int bal() const { return balance; }
+   void setBal(int b) { balance = static_cast<signed char>(b); }
+};
+// packed: the factor + 1 lives in the two low bits of the parent pointer
+template<class Node>
+struct avl_link<Node, true> {
+   static_assert(sizeof(size_t) == sizeof(Node *), "packed nodes keep a pointer in a size_t");
+   size_t bits = 1;
+   Node *parent() const { return reinterpret_cast<Node *>(bits & ~size_t(3)); }
+   void setParent(Node *p) { bits = reinterpret_cast<size_t>(p) | (bits & 3); }
+   int bal() const { return int(bits & 3) - 1; }
+   void setBal(int b) { bits = (bits & ~size_t(3)) | size_t(b + 1); }
+};
+
+}
+
+/**
+ * node layout options for sjtu::map.
+ * Threaded: each node also keeps prev/next links to its in-order
+ *   neighbours, so an iterator step is a single pointer load instead of a
+ *   climb through parent pointers. costs two pointers per node.
+ * Sized: each node also counts the nodes in its subtree, which enables
+ *   rank(), select() and index_of() in O(log n). costs one size_t per node
+ *   and a walk to the root on every insert and erase.
+ * Packed: the 2-bit balance factor is kept in the low bits of the parent
+ *   pointer instead of a field of its own, which saves a word per node when
+ *   the value's size is a multiple of the pointer size (e.g. int -> int:
+ *   40 -> 32 bytes on 64-bit). a parent access costs one extra mask.
+ * Counted: the map records comparisons, rotations, node allocations, descent
+ *   depths and iterator climbs, read back with stats(). nodes are unchanged;
+ *   every operation pays a few increments, and const lookups write the
+ *   counters, so a counted map must not be read from several threads.
+ * Timed: with Counted, insert, erase and find also sum timestamp-counter
+ *   ticks. without Counted none of this exists: no state, no code.
+ * Deferred: the map gets insert_deferred(), which queues elements in O(1)
+ *   and places them all at once when the map is next used. nodes are
+ *   unchanged; the map holds the queue, and every operation first checks
+ *   whether it is empty.
+ */
+template<bool Threaded = false, bool Sized = false, bool Packed = false, bool Counted = false, bool Timed = false,
+         bool Deferred = false>
+struct node_policy {
+   static const bool threaded = Threaded;
+   static const bool sized = Sized;
+   static const bool packed = Packed;
+   static const bool counted = Counted;
+   static const bool timed = Counted && Timed;
+   static const bool deferred = Deferred;
+};
+
+typedef node_policy<true> threaded_nodes;
+typedef node_policy<false, true> sized_nodes;
+typedef node_policy<false, false, true> compact_nodes;
+typedef node_policy<false, false, false, true> counted_nodes;
+typedef node_policy<false, false, false, false, false, true> deferred_nodes;
+
+/**
+ * what a map with the Counted policy has recorded since it was made or since
+ * reset_stats(); see map::stats(). histogram entry [i] counts the events of
+ * length i, the last entry those of buckets - 1 or more.
+ */
+struct map_stats {
+   static const int buckets = 64;
+   size_t comparisons = 0;
+   size_t left_rotations = 0;     // rotateLeft / rotateRight
+   size_t right_rotations = 0;
+   size_t single_rotations = 0;   // rebalancing steps made of one rotation, or two
+   size_t double_rotations = 0;
+   size_t allocations = 0;        // node slots taken from and returned to the allocator
+   size_t frees = 0;
+   size_t depth[buckets] = {};    // lookups and insert descents, by nodes visited
+   size_t climb[buckets] = {};    // iterator steps, by parent links followed
+   // Timed only: calls and their summed ticks
+   size_t inserts = 0;
+   size_t erases = 0;
+   size_t finds = 0;
+   unsigned long long insert_cycles = 0;
+   unsigned long long erase_cycles = 0;
+   unsigned long long find_cycles = 0;
+};
+
+/**
+ * heap memory an object owns on top of its own sizeof, as map::memory_usage()
+ * counts it. 0 unless specialized; specialize it (with owns = true) for types
+ * that keep buffers of their own.
+ */
+template<class U>
+struct heap_bytes {
+   static const bool owns = false;
+   static size_t of(const U &) { return 0; }
+};
+template<>
+struct heap_bytes<std::string> {
+   static const bool owns = true;
+   // nothing when the characters sit in the small-string buffer inside s
+   static size_t of(const std::string &s) {
+     const char *p = s.data(), *self = reinterpret_cast<const char *>(&s);
+     return p >= self && p < self + sizeof(s) ? 0 : s.capacity() + 1;
+   }
+};
+
+/**
+ * the memory one map uses, from map::memory_usage().
+ */
+struct map_memory {
+   size_t nodes = 0;
+   size_t node_bytes = 0;     // nodes * map::node_bytes(): the values and their links
+   size_t value_bytes = 0;    // the value_type objects alone, a part of node_bytes
+   size_t slack_bytes = 0;    // allocator memory around the nodes: free slots, chunk headers
+   size_t payload_bytes = 0;  // heap owned by keys and values, see heap_bytes
+   size_t total() const { return node_bytes + slack_bytes + payload_bytes; }
+};
+
+namespace detail {
+
+// adds the ticks between construction and destruction to one map_stats entry
+template<bool Timed> struct op_timer {
+   op_timer(map_stats *, size_t map_stats::*, unsigned long long map_stats::*) {}
+};
+template<>
+struct op_timer<true> {
+   map_stats *s;
+   size_t map_stats::*calls;
+   unsigned long long map_stats::*ticks;
+   unsigned long long start;
+   op_timer(map_stats *s, size_t map_stats::*calls, unsigned long long map_stats::*ticks)
+     : s(s), calls(calls), ticks(ticks), start(cycles()) {}
+   ~op_timer() {
+     ++(s->*calls);
+     s->*ticks += cycles() - start;
+   }
+};
+
+// the hooks behind map::stats(). the map derives from this, so when nothing
+// is counted the empty base takes no room and the hooks inline to nothing.
+template<bool Counted, bool Timed> struct op_counters {
+   typedef op_timer<false> timer;
+   map_stats *record() const { return nullptr; }
+   void rotated(bool) const {}
+   void rebalanced(bool) const {}
+   void allocated(size_t) const {}
+   void freed(size_t) const {}
+   void descended(int) const {}
+   void climbed(int) const {}
+};
+template<bool Timed>
+struct op_counters<true, Timed> {
+   typedef op_timer<Timed> timer;
+   mutable map_stats s;
+   static size_t bucket(int d) { return d < map_stats::buckets ? d : map_stats::buckets - 1; }
+   map_stats *record() const { return &s; }
+   void rotated(bool left) const { ++(left ? s.left_rotations : s.right_rotations); }
+   void rebalanced(bool twice) const { ++(twice ? s.double_rotations : s.single_rotations); }
+   void allocated(size_t cnt) const { s.allocations += cnt; }
+   void freed(size_t cnt) const { s.frees += cnt; }
+   void descended(int d) const { ++s.depth[bucket(d)]; }
+   void climbed(int d) const { ++s.climb[bucket(d)]; }
+};
+
+// Compare, or with Counted one that counts its calls; copies start from zero
+template<class Compare, bool Counted> struct stats_compare { typedef Compare type; };
+template<class Compare>
+struct stats_compare<Compare, true> {
+   struct type {
+     Compare comp;
+     mutable size_t calls = 0;
+     type() : comp() {}
+     type(const type &other) : comp(other.comp) {}
+     type &operator=(const type &other) {
+       comp = other.comp;
+       return *this;
+     }
+     template<class A, class B>
+     bool operator()(const A &a, const B &b) const {
+       ++calls;
+       return comp(a, b);
+     }
+   };
+};
+
+// the map's comparator. an empty one (std::less and most functors) is held as
+// a base, so it takes no room in the map.
+template<class C, bool Empty = __is_empty(C) && !__is_final(C)>
+struct compare_holder {
+   C cmp = C();
+   C &compare() { return cmp; }
+   const C &compare() const { return cmp; }
+   template<class A, class B>
+   bool comp(const A &a, const B &b) const { return cmp(a, b); }
+};
+template<class C>
+struct compare_holder<C, true> : C {
+   C &compare() { return *this; }
+   const C &compare() const { return *this; }
+   template<class A, class B>
+   bool comp(const A &a, const B &b) const { return static_cast<const C &>(*this)(a, b); }
+};
+
+// keys that fit in two registers and copy as plain bytes: lookups hold them by
+// value instead of reading them back through a reference
+template<class K> struct small_key {
+   static const bool value = __is_trivially_copyable(K) && sizeof(K) <= 2 * sizeof(void *);
+};
+// a string literal handed to a transparent lookup cannot be copied
+template<class K, size_t N> struct small_key<K[N]> { static const bool value = false; };
+template<class K, bool = small_key<K>::value> struct key_arg { typedef const K &type; };
+template<class K> struct key_arg<K, true> { typedef K type; };
+
+// the queue behind map::insert_deferred(): finished nodes, chained through
+// their right links. the map's Node type is not known up here, hence void *.
+// without the Deferred policy it holds nothing and pending() is a constant
+// false, so the map compiles every check away.
+template<bool Deferred> struct staging {
+   bool pending() const { return false; }
+};
+template<>
+struct staging<true> {
+   void *head = nullptr;
+   void *tail = nullptr;
+   size_t cnt = 0;
+   bool pending() const { return head != nullptr; }
+};
+
+}
+
 template<
    class Key,
    class T,
-   class Compare = std::less <Key>
-   > class map {
+   class Compare = std::less <Key>,
+   class Allocator = pool_allocator<pair<const Key, T> >,
+   class NodePolicy = node_policy<>
+   > class map : private detail::op_counters<NodePolicy::counted, NodePolicy::timed>,
+                 private detail::compare_holder<typename detail::stats_compare<Compare, NodePolicy::counted>::type>,
+                 private detail::staging<NodePolicy::deferred> {
   public:
    /**
   * the internal type of data.
@@ -26,65 +500,275 @@ template<
    typedef pair<const Key, T> value_type;
 
   private:
-   struct Node {
-     value_type value;
+   struct Node : detail::thread_links<Node, NodePolicy::threaded>, detail::subtree_size<NodePolicy::sized>,
+                 detail::avl_link<Node, NodePolicy::packed> {
+     // the children ahead of the value, so that a descent finds them in the
+     // cache line of the key it has just compared
      Node *left;
      Node *right;
-     Node *parent;
-     int height;
-     Node(const value_type &v, Node *p = nullptr)
-       : value(v), left(nullptr), right(nullptr), parent(p), height(1) {}
+     value_type value;
+     template<class... Args>
+     Node(Node *p, Args &&... args)
+       : left(nullptr), right(nullptr), value(std::forward<Args>(args)...) { this->setParent(p); }
    };
+   static_assert(!NodePolicy::packed || alignof(Node) >= 4, "packed nodes need two free low bits in node pointers");
+
+   typedef typename detail::rebind_alloc<Allocator, Node>::type NodeAllocator;
+   typedef detail::bool_tag<detail::is_pool<NodeAllocator>::value> Pooled;
 
    Node *root = nullptr;
+   Node *leftmost = nullptr;   // cached extremes: begin() and --end() in O(1)
+   Node *rightmost = nullptr;
    size_t n = 0;
-   Compare comp = Compare();
+   NodeAllocator alloc;
+
+   typedef detail::compare_holder<typename detail::stats_compare<Compare, NodePolicy::counted>::type> Comparer;
+   using Comparer::comp;
+   using Comparer::compare;
+
+   typedef detail::op_counters<NodePolicy::counted, NodePolicy::timed> Counters;
+   typedef typename Counters::timer Timer;
+   typedef detail::staging<NodePolicy::deferred> Staging;
+   typedef detail::bool_tag<NodePolicy::deferred> Defers;
+
+   Node *allocNodes(size_t cnt) {
+     Node *x = alloc.allocate(cnt);
+     this->allocated(cnt);
+     return x;
+   }
+   void freeNodes(Node *x, size_t cnt) {
+     alloc.deallocate(x, cnt);
+     this->freed(cnt);
+   }
+
+   template<class... Args>
+   Node *createNode(Args &&... args) {
+     Node *x = allocNodes(1);
+     try {
+       new (x) Node(std::forward<Args>(args)...);
+     } catch (...) {
+       freeNodes(x, 1);
+       throw;
+     }
+     return x;
+   }
+   void destroyNode(Node *x) {
+     x->~Node();
+     freeNodes(x, 1);
+   }
+
+   typedef detail::bool_tag<NodePolicy::sized> Sizes;
 
-   static int h(Node *x) { return x ? x->height : 0; }
-   static int max2(int a, int b) { return a > b ? a : b; }
-   static void upd(Node *x) { if (x) x->height = 1 + max2(h(x->left), h(x->right)); }
-   static int bf(Node *x) { return x ? h(x->left) - h(x->right) : 0; }
+   static size_t sz(Node *x) { return x ? x->size : 0; }
+   static void updSize(Node *x, detail::bool_tag<true>) { x->size = 1 + sz(x->left) + sz(x->right); }
+   static void updSize(Node *, detail::bool_tag<false>) {}
+   static void copyMeta(Node *to, const Node *from, detail::bool_tag<true>) { to->setBal(from->bal()); to->size = from->size; }
+   static void copyMeta(Node *to, const Node *from, detail::bool_tag<false>) { to->setBal(from->bal()); }
+   // sizes are brought up to date before rebalancing; rotations keep them right
+   static void resizeUp(Node *x, detail::bool_tag<true>) { for (; x; x = x->parent()) updSize(x, Sizes()); }
+   static void resizeUp(Node *, detail::bool_tag<false>) {}
 
-   Node *rotateRight(Node *y) {
+   // nodes only store the balance factor h(left) - h(right), in [-1, 1].
+   // heights are read off it along one downward path when they are needed.
+   static int height(Node *x) {
+     int h = 0;
+     for (; x; ++h) x = x->bal() < 0 ? x->right : x->left;
+     return h;
+   }
+   static int leftHeight(Node *x, int hx) { return x->bal() >= 0 ? hx - 1 : hx - 1 + x->bal(); }
+   static int rightHeight(Node *x, int hx) { return x->bal() <= 0 ? hx - 1 : hx - 1 - x->bal(); }
+
+   // the tree primitives below work on any tree whose root is held in top:
+   // the map's own root, or a detached subtree while splitting and joining.
+
+   // make x take old's place under parent (or as the root)
+   static void replaceChild(Node *parent, Node *old, Node *x, Node *&top) {
+     if (!parent) top = x;
+     else if (parent->left == old) parent->left = x;
+     else parent->right = x;
+   }
+
+   // rotations re-hook the new subtree root into the parent of the old one.
+   // they only move links; balance factors are set by the caller.
+   Node *rotateRight(Node *y, Node *&top) const {
+     this->rotated(false);
      Node *x = y->left;
+     Node *p = y->parent();
      Node *T2 = x->right;
-     x->right = y; y->parent = x;
-     y->left = T2; if (T2) T2->parent = y;
-     upd(y); upd(x);
-     x->parent = y->parent; // caller will re-hook
+     y->left = T2; if (T2) T2->setParent(y);
+     x->right = y; y->setParent(x);
+     x->setParent(p); replaceChild(p, y, x, top);
+     updSize(y, Sizes()); updSize(x, Sizes());
      return x;
    }
-   Node *rotateLeft(Node *x) {
+   Node *rotateLeft(Node *x, Node *&top) const {
+     this->rotated(true);
      Node *y = x->right;
+     Node *p = x->parent();
      Node *T2 = y->left;
-     y->left = x; x->parent = y;
-     x->right = T2; if (T2) T2->parent = x;
-     upd(x); upd(y);
-     y->parent = x->parent; // caller will re-hook
+     x->right = T2; if (T2) T2->setParent(x);
+     y->left = x; x->setParent(y);
+     y->setParent(p); replaceChild(p, x, y, top);
+     updSize(x, Sizes()); updSize(y, Sizes());
      return y;
    }
 
-   Node *rebalance(Node *node) {
-     upd(node);
-     int b = bf(node);
-     if (b > 1) { // left heavy
-       if (bf(node->left) < 0) {
-         node->left = rotateLeft(node->left);
-         if (node->left) node->left->parent = node;
+   // x is two levels heavier on the left (b == 2) or right (b == -2) and its
+   // stored factor is stale. rotate the subtree back into balance and return its
+   // new root; shrunk tells whether it came out a level lower than heavy x was.
+   Node *rotateBack(Node *x, int b, Node *&top, bool &shrunk) const {
+     if (b > 0) {
+       Node *l = x->left;
+       int lb = l->bal();
+       this->rebalanced(lb < 0);
+       if (lb >= 0) {
+         rotateRight(x, top);
+         x->setBal(1 - lb); l->setBal(lb - 1);
+         shrunk = lb != 0;
+         return l;
        }
-       Node *newRoot = rotateRight(node);
-       if (newRoot->right) newRoot->right->parent = newRoot;
-       return newRoot;
-     } else if (b < -1) { // right heavy
-       if (bf(node->right) > 0) {
-         node->right = rotateRight(node->right);
-         if (node->right) node->right->parent = node;
+       Node *g = l->right;
+       int gb = g->bal();
+       rotateLeft(l, top); rotateRight(x, top);
+       l->setBal(gb < 0 ? 1 : 0); x->setBal(gb > 0 ? -1 : 0); g->setBal(0);
+       shrunk = true;
+       return g;
+     }
+     Node *r = x->right;
+     int rb = r->bal();
+     this->rebalanced(rb > 0);
+     if (rb <= 0) {
+       rotateLeft(x, top);
+       x->setBal(-1 - rb); r->setBal(rb + 1);
+       shrunk = rb != 0;
+       return r;
+     }
+     Node *g = r->left;
+     int gb = g->bal();
+     rotateRight(r, top); rotateLeft(x, top);
+     r->setBal(gb > 0 ? -1 : 0); x->setBal(gb < 0 ? 1 : 0); g->setBal(0);
+     shrunk = true;
+     return g;
+   }
+
+   // the subtree under x just got a level taller: fix the factors above it until
+   // some subtree keeps its old height. returns true if top itself grew.
+   bool growUp(Node *x, Node *&top) const {
+     for (Node *p = x->parent(); p; x = p, p = p->parent()) {
+       int b = p->bal() + (p->left == x ? 1 : -1);
+       if (b == 0) { p->setBal(0); return false; }
+       if (b == 1 || b == -1) { p->setBal(b); continue; }
+       bool shrunk;
+       p = rotateBack(p, b, top, shrunk);
+       if (shrunk) return false;
+     }
+     return true;
+   }
+
+   // the left (fromLeft) or right subtree of p just got a level lower; the same
+   // walk for removals. returns true if top itself shrank.
+   bool shrinkUp(Node *p, bool fromLeft, Node *&top) const {
+     while (p) {
+       Node *g = p->parent();
+       bool gl = g && g->left == p;
+       int b = p->bal() + (fromLeft ? -1 : 1);
+       if (b == 1 || b == -1) { p->setBal(b); return false; }
+       if (b == 0) p->setBal(0);
+       else {
+         bool shrunk;
+         rotateBack(p, b, top, shrunk);
+         if (!shrunk) return false;
        }
-       Node *newRoot = rotateLeft(node);
-       if (newRoot->left) newRoot->left->parent = newRoot;
-       return newRoot;
+       p = g; fromLeft = gl;
+     }
+     return true;
+   }
+
+   // l < k < r, all detached (null parents), of heights hl and hr; returns the
+   // root of the joined tree and its height in h. k hangs off the spine of the
+   // taller side, so the cost is O(|hl - hr| + 1).
+   Node *joinTrees(Node *l, int hl, Node *k, Node *r, int hr, int &h) const {
+     if (hl > hr + 1) {
+       Node *p = nullptr, *c = l;
+       int hc = hl;
+       while (hc > hr + 1) { hc -= c->bal() > 0 ? 2 : 1; p = c; c = c->right; }
+       k->left = c; if (c) c->setParent(k);
+       k->right = r; if (r) r->setParent(k);
+       k->setBal(hc - hr);
+       k->setParent(p); p->right = k;
+       updSize(k, Sizes());
+       resizeUp(p, Sizes());
+       Node *top = l;
+       h = growUp(k, top) ? hl + 1 : hl;
+       return top;
+     }
+     if (hr > hl + 1) {
+       Node *p = nullptr, *c = r;
+       int hc = hr;
+       while (hc > hl + 1) { hc -= c->bal() < 0 ? 2 : 1; p = c; c = c->left; }
+       k->right = c; if (c) c->setParent(k);
+       k->left = l; if (l) l->setParent(k);
+       k->setBal(hl - hc);
+       k->setParent(p); p->left = k;
+       updSize(k, Sizes());
+       resizeUp(p, Sizes());
+       Node *top = r;
+       h = growUp(k, top) ? hr + 1 : hr;
+       return top;
+     }
+     k->left = l; if (l) l->setParent(k);
+     k->right = r; if (r) r->setParent(k);
+     k->setParent(nullptr);
+     k->setBal(hl - hr);
+     updSize(k, Sizes());
+     h = 1 + (hl > hr ? hl : hr);
+     return k;
+   }
+
+   // join without a middle node: the minimum of r is pulled out to play that part
+   Node *joinTrees(Node *l, Node *r) const {
+     if (!l) return r;
+     if (!r) return l;
+     int hl = height(l), hr = height(r), h;
+     Node *m = r;
+     while (m->left) m = m->left;
+     Node *p = m->parent();
+     if (m->right) m->right->setParent(p);
+     replaceChild(p, m, m->right, r);
+     resizeUp(p, Sizes());
+     if (shrinkUp(p, true, r)) --hr;
+     if (r) r->setParent(nullptr);
+     return joinTrees(l, hl, m, r, hr, h);
+   }
+
+   // cut the tree holding x into the keys before x (lo) and x with all keys after it (hi).
+   // climbs from x and joins the pieces met on the way: O(log n) in total. the
+   // height of each piece follows from the one below it and its parent's factor.
+   void splitAt(Node *x, Node *&lo, Node *&hi) const {
+     Node *p = x->parent();
+     bool fromLeft = p && p->left == x;
+     int h = height(x), hlo = leftHeight(x, h), hhi;
+     lo = x->left; if (lo) lo->setParent(nullptr);
+     Node *r = x->right; if (r) r->setParent(nullptr);
+     int hr = rightHeight(x, h);
+     x->left = x->right = nullptr; x->setParent(nullptr);
+     hi = joinTrees(nullptr, 0, x, r, hr, hhi);
+     while (p) {
+       Node *next = p->parent();
+       bool nextFromLeft = next && next->left == p;
+       int hs = fromLeft ? h - p->bal() : h + p->bal();  // p's other child
+       h = 1 + (h > hs ? h : hs);
+       Node *pl = p->left, *pr = p->right;
+       p->left = p->right = nullptr; p->setParent(nullptr);
+       if (fromLeft) {
+         if (pr) pr->setParent(nullptr);
+         hi = joinTrees(hi, hhi, p, pr, hs, hhi);
+       } else {
+         if (pl) pl->setParent(nullptr);
+         lo = joinTrees(pl, hs, p, lo, hlo, hlo);
+       }
+       p = next; fromLeft = nextFromLeft;
      }
-     return node;
    }
 
    Node *minNode(Node *x) const {
@@ -98,119 +782,912 @@ template<
      return x;
    }
 
-   Node *successor(Node *x) const {
+   typedef detail::bool_tag<NodePolicy::threaded> Threads;
+
+   // the steps iterators take; internal walks call the tagged versions directly
+   Node *successor(Node *x) const { return successor(x, Threads(), *this); }
+   Node *predecessor(Node *x) const { return predecessor(x, Threads(), *this); }
+
+   template<class C>
+   static Node *successor(Node *x, detail::bool_tag<true>, const C &) { return x ? x->next : nullptr; }
+   template<class C>
+   static Node *predecessor(Node *x, detail::bool_tag<true>, const C &) { return x ? x->prev : nullptr; }
+
+   // C counts the parent links climbed
+   template<class C>
+   static Node *successor(Node *x, detail::bool_tag<false>, const C &c) {
      if (!x) return nullptr;
      if (x->right) {
        Node *t = x->right;
        while (t->left) t = t->left;
+       c.climbed(0);
        return t;
      }
-     Node *p = x->parent;
-     while (p && x == p->right) { x = p; p = p->parent; }
+     Node *p = x->parent();
+     int up = 1;
+     for (; p && x == p->right; ++up) { x = p; p = p->parent(); }
+     c.climbed(up);
      return p;
    }
-   Node *predecessor(Node *x) const {
+   template<class C>
+   static Node *predecessor(Node *x, detail::bool_tag<false>, const C &c) {
      if (!x) return nullptr;
      if (x->left) {
        Node *t = x->left;
        while (t->right) t = t->right;
+       c.climbed(0);
        return t;
      }
-     Node *p = x->parent;
-     while (p && x == p->left) { x = p; p = p->parent; }
+     Node *p = x->parent();
+     int up = 1;
+     for (; p && x == p->left; ++up) { x = p; p = p->parent(); }
+     c.climbed(up);
      return p;
    }
+   template<bool Threaded>
+   static Node *successor(Node *x, detail::bool_tag<Threaded> t) { return successor(x, t, detail::op_counters<false, false>()); }
+   template<bool Threaded>
+   static Node *predecessor(Node *x, detail::bool_tag<Threaded> t) { return predecessor(x, t, detail::op_counters<false, false>()); }
+
+   // keep the prev/next threads in step with the tree shape
+   static void threadIn(Node *x, Node *parent, bool toLeft, detail::bool_tag<true>) {
+     if (!parent) { x->prev = x->next = nullptr; return; }
+     if (toLeft) {
+       x->next = parent; x->prev = parent->prev;
+       if (x->prev) x->prev->next = x;
+       parent->prev = x;
+     } else {
+       x->prev = parent; x->next = parent->next;
+       if (x->next) x->next->prev = x;
+       parent->next = x;
+     }
+   }
+   static void threadOut(Node *x, detail::bool_tag<true>) {
+     if (x->prev) x->prev->next = x->next;
+     if (x->next) x->next->prev = x->prev;
+   }
+   void rethread(detail::bool_tag<true>) {
+     Node *prev = nullptr;
+     for (Node *x = leftmost; x; x = successor(x, detail::bool_tag<false>())) {
+       x->prev = prev;
+       if (prev) prev->next = x;
+       prev = x;
+     }
+     if (prev) prev->next = nullptr;
+   }
+   static void threadIn(Node *, Node *, bool, detail::bool_tag<false>) {}
+   static void threadOut(Node *, detail::bool_tag<false>) {}
+   void rethread(detail::bool_tag<false>) {}
 
-   Node *findNode(const Key &key) const {
+   template<class K>
+   Node *findNode(const K &key) const {
+     settle();
+     typename detail::key_arg<K>::type k = key;
      Node *cur = root;
-     while (cur) {
-       if (comp(key, cur->value.first)) cur = cur->left;
-       else if (comp(cur->value.first, key)) cur = cur->right;
-       else return cur;
+     int depth = 0;
+     for (; cur; ++depth) {
+       if (comp(k, cur->value.first)) cur = cur->left;
+       else if (comp(cur->value.first, k)) cur = cur->right;
+       else { this->descended(depth + 1); return cur; }
      }
+     this->descended(depth);
      return nullptr;
    }
 
-   Node *insertNode(Node *node, Node *parent, const value_type &val, bool &inserted, Node **insertedPtr) {
-     if (!node) {
-       Node *nn = new Node(val, parent);
-       inserted = true; *insertedPtr = nn; ++n;
-       return nn;
+   // hang a fresh node below parent and restore balance
+   void linkNode(Node *x, Node *parent, bool toLeft) {
+     x->setParent(parent);
+     if (!parent) root = leftmost = rightmost = x;
+     else if (toLeft) { parent->left = x; if (parent == leftmost) leftmost = x; }
+     else { parent->right = x; if (parent == rightmost) rightmost = x; }
+     threadIn(x, parent, toLeft, Threads());
+     ++n;
+     resizeUp(parent, Sizes());
+     growUp(x, root);
+   }
+
+   // first node whose key is not less than key
+   template<class K>
+   Node *lowerNode(const K &key) const {
+     settle();
+     typename detail::key_arg<K>::type k = key;
+     Node *cur = root, *res = nullptr;
+     int depth = 0;
+     for (; cur; ++depth) {
+       if (comp(cur->value.first, k)) cur = cur->right;
+       else { res = cur; cur = cur->left; }
      }
-     if (comp(val.first, node->value.first)) {
-       node->left = insertNode(node->left, node, val, inserted, insertedPtr);
-     } else if (comp(node->value.first, val.first)) {
-       node->right = insertNode(node->right, node, val, inserted, insertedPtr);
-     } else {
-       inserted = false; *insertedPtr = node;
-       return node;
+     this->descended(depth);
+     return res;
+   }
+   // first node whose key is greater than key
+   template<class K>
+   Node *upperNode(const K &key) const {
+     settle();
+     typename detail::key_arg<K>::type k = key;
+     Node *cur = root, *res = nullptr;
+     int depth = 0;
+     for (; cur; ++depth) {
+       if (comp(k, cur->value.first)) { res = cur; cur = cur->left; }
+       else cur = cur->right;
      }
-     Node *res = rebalance(node);
-     if (res->left) res->left->parent = res;
-     if (res->right) res->right->parent = res;
-     res->parent = parent;
+     this->descended(depth);
      return res;
    }
+   // position of x in key order, counted with subtree sizes
+   static size_t indexOf(Node *x) {
+     size_t idx = sz(x->left);
+     for (Node *p = x->parent(); p; x = p, p = p->parent())
+       if (p->right == x) idx += sz(p->left) + 1;
+     return idx;
+   }
+
+   // look up every key of [first, last) and hand the result for each to sink,
+   // in input order. descents run in groups of batchWidth, one level of each
+   // per round, and the next node of a descent is prefetched before the other
+   // descents of the group are advanced, so up to batchWidth misses overlap.
+   static const int batchWidth = 8;
+   template<class ForwardIt, class Sink>
+   void findBatch(ForwardIt first, ForwardIt last, Sink sink) const {
+     settle();
+     while (first != last) {
+       decltype(&*first) key[batchWidth];
+       Node *cur[batchWidth], *res[batchWidth];
+       int cnt = 0;
+       for (; cnt < batchWidth && first != last; ++first, ++cnt) {
+         key[cnt] = &*first;
+         cur[cnt] = root;
+         res[cnt] = nullptr;
+       }
+       for (int active = cnt; active; ) {
+         active = 0;
+         for (int i = 0; i < cnt; ++i) {
+           Node *x = cur[i];
+           if (!x) continue;
+           if (comp(*key[i], x->value.first)) x = x->left;
+           else if (comp(x->value.first, *key[i])) x = x->right;
+           else { res[i] = x; x = nullptr; }
+           cur[i] = x;
+           if (x) { detail::prefetch(&x->value); ++active; }
+         }
+       }
+       for (int i = 0; i < cnt; ++i) sink(res[i]);
+     }
+   }
+
+   // one descent: the node holding key, or nullptr plus the place a new node would go
+   Node *findInsertPos(const Key &key, Node *&parent, bool &toLeft) const {
+     settle();
+     return descendFrom(root, key, parent, toLeft);
+   }
 
-   // Erase by node pointer using rotations to delete the target node itself (preserves neighbors' validity)
-   Node *eraseByNode(Node *node, Node *target, bool &erased) {
-     if (!node) return nullptr;
-     if (node == target) {
-       if (!node->left || !node->right) {
-         erased = true; --n;
-         Node *child = node->left ? node->left : node->right;
-         if (child) child->parent = node->parent;
-         Node *ret = child;
-         delete node;
-         return ret;
+   Node *descendFrom(Node *cur, const Key &key, Node *&parent, bool &toLeft) const {
+     typename detail::key_arg<Key>::type k = key;
+     parent = nullptr; toLeft = false;
+     int depth = 0;
+     for (; cur; ++depth) {
+       parent = cur;
+       if (comp(k, cur->value.first)) { cur = cur->left; toLeft = true; }
+       else if (comp(cur->value.first, k)) { cur = cur->right; toLeft = false; }
+       else { this->descended(depth + 1); return cur; }
+     }
+     this->descended(depth);
+     return nullptr;
+   }
+
+   // finger search: like findInsertPos, but starting from x. climbs only until an
+   // ancestor bounds key on the far side, then descends from there; keys d
+   // positions away from x are reached in O(log d) amortized.
+   Node *findInsertFrom(Node *x, const Key &key, Node *&parent, bool &toLeft) const {
+     if (comp(x->value.first, key)) {
+       for (Node *p = x->parent(); p; x = p, p = p->parent()) {
+         if (x != p->left) continue;
+         if (comp(key, p->value.first)) break;
+         if (!comp(p->value.first, key)) return p;
+       }
+     } else if (comp(key, x->value.first)) {
+       for (Node *p = x->parent(); p; x = p, p = p->parent()) {
+         if (x != p->right) continue;
+         if (comp(p->value.first, key)) break;
+         if (!comp(key, p->value.first)) return p;
+       }
+     } else {
+       return x;
+     }
+     return descendFrom(x, key, parent, toLeft);
+   }
+
+   // where key goes when the caller expects it between the neighbours before and
+   // after (nullptr: the front / the end). a right guess is O(1): the free slot is
+   // then the right child of before or the left child of after. the caller must
+   // have placed the deferred queue before it read the neighbours.
+   Node *findInsertNear(Node *before, Node *after, const Key &key, Node *&parent, bool &toLeft) const {
+     if ((!before || comp(before->value.first, key)) && (!after || comp(key, after->value.first))) {
+       if (before && !before->right) { parent = before; toLeft = false; }
+       else { parent = after; toLeft = true; }
+       return nullptr;
+     }
+     return findInsertFrom(before && !comp(before->value.first, key) ? before : after, key, parent, toLeft);
+   }
+
+   template<class V>
+   Node *insertNear(Node *before, Node *after, V &&val, bool &inserted) {
+     Node *parent; bool toLeft;
+     Node *x = findInsertNear(before, after, val.first, parent, toLeft);
+     inserted = !x;
+     if (x) return x;
+     x = createNode(parent, std::forward<V>(val));
+     linkNode(x, parent, toLeft);
+     return x;
+   }
+
+   // insert one by one, each search starting next to the element handled last,
+   // so a sorted or nearly sorted run costs amortized O(1) per element to place
+   template<class It>
+   void insertRun(It first, It last) {
+     if (first == last) return;
+     bool inserted;
+     Node *x = insertNode(*first, inserted);
+     for (++first; first != last; ++first) x = insertNear(x, successor(x), *first, inserted);
+   }
+
+   template<class V>
+   Node *insertNode(V &&val, bool &inserted) {
+     Node *parent; bool toLeft;
+     Node *x = findInsertPos(val.first, parent, toLeft);
+     inserted = !x;
+     if (x) return x;
+     x = createNode(parent, std::forward<V>(val));
+     linkNode(x, parent, toLeft);
+     return x;
+   }
+
+   // remove [first, last) (last == nullptr: up to the end). short runs are erased
+   // one by one; longer ones are cut out with two splits and a join, O(k + log n).
+   void eraseRange(Node *first, Node *last) {
+     settle();
+     Node *x = first;
+     for (int i = 0; i < 8 && x != last; ++i) x = successor(x);
+     if (x == last) {
+       while (first != last) { Node *nx = successor(first); eraseNode(first); first = nx; }
+       return;
+     }
+     Node *before = predecessor(first);
+     Node *lo, *mid, *hi = nullptr;
+     splitAt(first, lo, mid);
+     if (last) splitAt(last, mid, hi);
+     n -= destroy(mid);
+     root = joinTrees(lo, hi);
+     leftmost = minNode(root);
+     rightmost = maxNode(root);
+     relinkThreads(before, last, Threads());
+   }
+   static void relinkThreads(Node *before, Node *after, detail::bool_tag<true>) {
+     if (before) before->next = after;
+     if (after) after->prev = before;
+   }
+   static void relinkThreads(Node *, Node *, detail::bool_tag<false>) {}
+
+   // take z out of the tree without freeing it. a node with two children is
+   // replaced by its in-order successor, relinked into z's place, so no value
+   // moves and every other node keeps its address.
+   void unlinkNode(Node *z) {
+     settle();
+     if (z == leftmost) leftmost = successor(z);
+     if (z == rightmost) rightmost = predecessor(z);
+     threadOut(z, Threads());
+     Node *fix;  // the lowest node whose subtree lost a level, on its fromLeft side
+     bool fromLeft;
+     if (!z->left || !z->right) {
+       Node *child = z->left ? z->left : z->right;
+       fix = z->parent();
+       fromLeft = fix && fix->left == z;
+       if (child) child->setParent(fix);
+       replaceChild(fix, z, child, root);
+     } else {
+       Node *y = z->right;
+       while (y->left) y = y->left;
+       if (y->parent() != z) {
+         fix = y->parent();
+         fromLeft = true;
+         fix->left = y->right;
+         if (y->right) y->right->setParent(fix);
+         y->right = z->right;
+         y->right->setParent(y);
        } else {
-         // rotate to push target down until it has at most one child
-         if (bf(node) >= 0) {
-           Node *newRoot = rotateRight(node);
-           // old 'node' becomes newRoot->right (same pointer 'target')
-           newRoot->right = eraseByNode(newRoot->right, target, erased);
-           if (newRoot->right) newRoot->right->parent = newRoot;
-           Node *res = rebalance(newRoot);
-           if (res->left) res->left->parent = res;
-           if (res->right) res->right->parent = res;
-           return res;
+         fix = y;
+         fromLeft = false;
+       }
+       y->left = z->left;
+       y->left->setParent(y);
+       y->setParent(z->parent());
+       replaceChild(z->parent(), z, y, root);
+       copyMeta(y, z, Sizes());
+     }
+     --n;
+     resizeUp(fix, Sizes());
+     shrinkUp(fix, fromLeft, root);
+   }
+
+   void eraseNode(Node *z) {
+     unlinkNode(z);
+     destroyNode(z);
+   }
+
+   // nodes handed over from another map must come from an allocator we can free them with
+   void shareAllocator(map &other, detail::bool_tag<true>) { alloc.merge(other.alloc); }
+   void shareAllocator(map &, detail::bool_tag<false>) {}
+
+   // how many of total nodes ended up in hi after a split
+   static size_t upperCount(Node *, Node *hi, size_t, detail::bool_tag<true>) { return sz(hi); }
+   // without sizes: walk both parts in lockstep and stop as soon as one runs
+   // out, so the cost is O(min(|lo|, |hi|)) rather than O(n)
+   static size_t upperCount(Node *lo, Node *hi, size_t total, detail::bool_tag<false>) {
+     Node *a = lo, *b = hi;
+     while (a && a->left) a = a->left;
+     while (b && b->left) b = b->left;
+     size_t cnt = 0;
+     while (a && b) {
+       a = successor(a, detail::bool_tag<false>());
+       b = successor(b, detail::bool_tag<false>());
+       ++cnt;
+     }
+     return a ? cnt : total - cnt;
+   }
+
+   // unhook every node below x into a list chained through right, in key order.
+   // rotating left children up as we go keeps this O(n) without recursion.
+   static Node *flatten(Node *x) {
+     Node *head = nullptr, *tail = nullptr;
+     while (x) {
+       if (x->left) {
+         Node *l = x->left;
+         x->left = l->right;
+         l->right = x;
+         x = l;
+       } else {
+         Node *r = x->right;
+         x->right = nullptr;
+         if (tail) tail->right = x; else head = x;
+         tail = x;
+         x = r;
+       }
+     }
+     return head;
+   }
+
+   // free a whole detached tree, returning how many nodes it held
+   size_t destroy(Node *x) {
+     size_t cnt = 0;
+     for (x = flatten(x); x; ++cnt) {
+       Node *nx = x->right;
+       destroyNode(x);
+       x = nx;
+     }
+     return cnt;
+   }
+
+   // run the destructors only; the memory goes back in one piece afterwards
+   void destroyValues(Node *x) {
+     for (x = flatten(x); x; ) {
+       Node *nx = x->right;
+       x->~Node();
+       x = nx;
+     }
+   }
+
+   void destroyAll(detail::bool_tag<true>) {
+     if (!alloc.unique()) { destroy(root); return; }
+     destroyValues(root);
+     alloc.release();
+     this->freed(n);
+   }
+   void destroyAll(detail::bool_tag<false>) { destroy(root); }
+
+   // moving is only safe when it cannot throw halfway through the tree
+   static const bool moveValues = noexcept(value_type(std::declval<value_type>()));
+   template<bool Move, class = void> struct valueRef { typedef value_type &&type; };
+   template<class D> struct valueRef<false, D> { typedef const value_type &type; };
+
+   // the nodes from x on in key order, their values handed out as rvalues
+   // (Move) or lvalues; what compact() builds the new nodes from
+   template<bool Move>
+   struct nodeValues {
+     Node *x;
+     explicit nodeValues(Node *x) : x(x) {}
+     typename valueRef<Move>::type operator*() const { return static_cast<typename valueRef<Move>::type>(x->value); }
+     nodeValues &operator++() {
+       x = successor(x, Threads());
+       return *this;
+     }
+     bool operator==(const nodeValues &rhs) const { return x == rhs.x; }
+     bool operator!=(const nodeValues &rhs) const { return x != rhs.x; }
+   };
+
+   // a fresh arena for the repacked nodes; other allocators keep theirs
+   void renewAllocator(detail::bool_tag<true>) { alloc = NodeAllocator(); }
+   void renewAllocator(detail::bool_tag<false>) {}
+
+   // free a detached tree through the allocator its nodes came from. a pool
+   // no other map shares goes back to the heap whole.
+   void dropTree(Node *x, NodeAllocator &from, detail::bool_tag<true>) {
+     if (!from.unique()) { dropTree(x, from, detail::bool_tag<false>()); return; }
+     this->freed(n);
+     destroyValues(x);
+     from.release();
+   }
+   void dropTree(Node *x, NodeAllocator &from, detail::bool_tag<false>) {
+     for (x = flatten(x); x; ) {
+       Node *nx = x->right;
+       x->~Node();
+       from.deallocate(x, 1);
+       this->freed(1);
+       x = nx;
+     }
+   }
+
+   // Walk: run payload over the elements; not needed when nothing owns heap memory
+   template<class F>
+   size_t payloadBytes(F payload, detail::bool_tag<true>) const {
+     size_t res = 0;
+     for (Node *x = leftmost; x; x = successor(x, Threads())) res += payload(x->value);
+     return res;
+   }
+   template<class F>
+   size_t payloadBytes(F, detail::bool_tag<false>) const { return 0; }
+   struct ownedBytes {
+     size_t operator()(const value_type &v) const { return heap_bytes<Key>::of(v.first) + heap_bytes<T>::of(v.second); }
+   };
+   size_t slackBytes(detail::bool_tag<true>) const { return alloc.reserved_bytes() - alloc.used_bytes(); }
+   size_t slackBytes(detail::bool_tag<false>) const { return 0; }
+   template<class F, bool Walk>
+   map_memory usage(F payload, detail::bool_tag<Walk> walk) const {
+     settle();
+     map_memory res;
+     res.nodes = n;
+     res.node_bytes = n * sizeof(Node);
+     res.value_bytes = n * sizeof(value_type);
+     res.slack_bytes = slackBytes(Pooled());
+     res.payload_bytes = payloadBytes(payload, walk);
+     return res;
+   }
+
+   // a node holding a copy of v, recycled from the spare list when there is one
+   Node *reuseOrCreate(Node *&spare, Node *parent, const value_type &v) {
+     if (!spare) return createNode(parent, v);
+     Node *x = spare;
+     spare = spare->right;
+     x->~Node();
+     try {
+       new (x) Node(parent, v);
+     } catch (...) {
+       freeNodes(x, 1);
+       throw;
+     }
+     return x;
+   }
+
+   // copy the shape and values of src, walking it through parent links instead of recursing
+   Node *clone(Node *src, Node *&spare) {
+     if (!src) return nullptr;
+     Node *top = reuseOrCreate(spare, nullptr, src->value);
+     copyMeta(top, src, Sizes());
+     try {
+       Node *s = src, *d = top;
+       while (true) {
+         if (s->left && !d->left) {
+           s = s->left;
+           d->left = reuseOrCreate(spare, d, s->value);
+           d = d->left;
+         } else if (s->right && !d->right) {
+           s = s->right;
+           d->right = reuseOrCreate(spare, d, s->value);
+           d = d->right;
          } else {
-           Node *newRoot = rotateLeft(node);
-           newRoot->left = eraseByNode(newRoot->left, target, erased);
-           if (newRoot->left) newRoot->left->parent = newRoot;
-           Node *res = rebalance(newRoot);
-           if (res->left) res->left->parent = res;
-           if (res->right) res->right->parent = res;
-           return res;
+           if (s == src) break;
+           s = s->parent(); d = d->parent();
+           continue;
          }
+         copyMeta(d, s, Sizes());
        }
-     } else if (comp(target->value.first, node->value.first)) {
-       node->left = eraseByNode(node->left, target, erased);
-       if (node->left) node->left->parent = node;
-     } else {
-       node->right = eraseByNode(node->right, target, erased);
-       if (node->right) node->right->parent = node;
+     } catch (...) {
+       destroy(top);
+       throw;
+     }
+     return top;
+   }
+
+   // become a copy of other, recycling our current nodes before asking the allocator
+   void copyFrom(const map &other) {
+     other.settle();
+     dropQueue(Defers());
+     Node *spare = flatten(root);
+     root = leftmost = rightmost = nullptr;
+     n = 0;
+     try {
+       root = clone(other.root, spare);
+     } catch (...) {
+       destroy(spare);
+       throw;
+     }
+     destroy(spare);
+     n = other.n;
+     leftmost = minNode(root);
+     rightmost = maxNode(root);
+     rethread(Threads());
+   }
+
+   // is [first, last) ordered by key? cnt receives the number of distinct keys
+   template<class It>
+   bool sortedRange(It first, It last, size_t &cnt) const {
+     cnt = 0;
+     if (first == last) return true;
+     cnt = 1;
+     It prev = first;
+     for (++first; first != last; prev = first, ++first) {
+       if (comp((*first).first, (*prev).first)) return false;
+       if (comp((*prev).first, (*first).first)) ++cnt;
+     }
+     return true;
+   }
+
+   // build the nodes of a sorted range, chained through right, in key order.
+   // a pool hands the whole run out as one contiguous block.
+   template<class It>
+   Node *makeChain(It first, It last, size_t cnt, detail::bool_tag<true>) {
+     Node *block = allocNodes(cnt);
+     size_t built = 0;
+     try {
+       for (It prev = last; first != last; prev = first, ++first) {
+         if (prev != last && !comp((*prev).first, (*first).first)) continue;
+         new (block + built) Node(nullptr, *first);
+         ++built;
+         if (built > 1) block[built - 2].right = block + built - 1;
+       }
+     } catch (...) {
+       for (size_t i = 0; i < built; ++i) block[i].~Node();
+       freeNodes(block, cnt);
+       throw;
+     }
+     return block;
+   }
+   template<class It>
+   Node *makeChain(It first, It last, size_t, detail::bool_tag<false>) {
+     Node *head = nullptr, *tail = nullptr;
+     try {
+       for (It prev = last; first != last; prev = first, ++first) {
+         if (prev != last && !comp((*prev).first, (*first).first)) continue;
+         Node *x = createNode(nullptr, *first);
+         if (tail) tail->right = x; else head = x;
+         tail = x;
+       }
+     } catch (...) {
+       while (head) { Node *nx = head->right; destroyNode(head); head = nx; }
+       throw;
      }
-     Node *res = rebalance(node);
-     if (res->left) res->left->parent = res;
-     if (res->right) res->right->parent = res;
+     return head;
+   }
+
+   // height of the subtree buildBalanced makes out of cnt nodes
+   static int bits(size_t cnt) {
+     int b = 0;
+     for (; cnt; cnt >>= 1) ++b;
+     return b;
+   }
+   // turn the next cnt nodes of a right-linked chain into a perfectly balanced subtree
+   static Node *buildBalanced(Node *&head, size_t cnt, Node *parent) {
+     if (!cnt) return nullptr;
+     Node *left = buildBalanced(head, cnt / 2, nullptr);
+     Node *x = head;
+     head = head->right;
+     x->setParent(parent);
+     x->left = left;
+     if (left) left->setParent(x);
+     x->right = buildBalanced(head, cnt - cnt / 2 - 1, x);
+     x->setBal(bits(cnt / 2) - bits(cnt - cnt / 2 - 1));
+     updSize(x, Sizes());
+     return x;
+   }
+
+   // stable merge of two right-linked chains in key order; a wins ties
+   Node *mergeChains(Node *a, Node *b) const {
+     Node *res = nullptr, **tail = &res;
+     for (; a && b; tail = &(*tail)->right) {
+       if (comp(b->value.first, a->value.first)) { *tail = b; b = b->right; }
+       else { *tail = a; a = a->right; }
+     }
+     *tail = a ? a : b;
+     return res;
+   }
+   // stable bottom-up merge sort of a chain: bin i holds a run of 2^i nodes,
+   // and every bin holds nodes from earlier in the chain than the bins below
+   Node *sortChain(Node *head) const {
+     Node *bin[64] = {};
+     while (head) {
+       Node *run = head;
+       head = head->right;
+       run->right = nullptr;
+       int i = 0;
+       for (; bin[i]; ++i) { run = mergeChains(bin[i], run); bin[i] = nullptr; }
+       bin[i] = run;
+     }
+     Node *res = nullptr;
+     for (int i = 0; i < 64; ++i)
+       if (bin[i]) res = mergeChains(bin[i], res);
      return res;
    }
 
-   void destroy(Node *x) {
-     if (!x) return;
-     destroy(x->left);
-     destroy(x->right);
-     delete x;
+   // every operation but insert_deferred() starts here: place the queued
+   // nodes first. logically const, since it changes the shape of the tree but
+   // not its contents.
+   void settle() const {
+     if (this->pending()) const_cast<map *>(this)->place(Defers());
+   }
+   void place(detail::bool_tag<false>) {}
+   // sort the queue, then drop the keys the tree or an earlier queued node
+   // already has. a short queue is inserted node by node, each search starting
+   // at the node placed last; a long one is merged with the flattened tree,
+   // which is then rebuilt perfectly balanced in O(n + m).
+   void place(detail::bool_tag<true>) {
+     Node *head = sortChain(static_cast<Node *>(this->head));
+     size_t cnt = this->cnt;
+     static_cast<Staging &>(*this) = Staging();
+     if (cnt * bits(n) < n) {
+       for (Node *prev = nullptr; head; ) {
+         Node *x = head;
+         head = head->right;
+         x->right = nullptr;
+         Node *parent; bool toLeft;
+         Node *dup = prev ? findInsertFrom(prev, x->value.first, parent, toLeft)
+                          : descendFrom(root, x->value.first, parent, toLeft);
+         if (dup) { destroyNode(x); continue; }
+         linkNode(x, parent, toLeft);
+         prev = x;
+       }
+       return;
+     }
+     Node *t = flatten(root), *res = nullptr, **tail = &res;
+     size_t total = 0;
+     while (t || head) {
+       Node *x;
+       if (!head || (t && !comp(head->value.first, t->value.first))) { x = t; t = t->right; }
+       else { x = head; head = head->right; }
+       while (head && !comp(x->value.first, head->value.first)) {
+         Node *dup = head;
+         head = head->right;
+         destroyNode(dup);
+       }
+       *tail = x;
+       tail = &x->right;
+       ++total;
+     }
+     *tail = nullptr;
+     n = total;
+     root = buildBalanced(res, n, nullptr);
+     leftmost = minNode(root);
+     rightmost = maxNode(root);
+     rethread(Threads());
+   }
+   // free the queue unplaced (clear and assignment)
+   void dropQueue(detail::bool_tag<true>) {
+     for (Node *x = static_cast<Node *>(this->head); x; ) {
+       Node *nx = x->right;
+       destroyNode(x);
+       x = nx;
+     }
+     static_cast<Staging &>(*this) = Staging();
+   }
+   void dropQueue(detail::bool_tag<false>) {}
+   void queueNode(Node *x) {
+     static_assert(NodePolicy::deferred, "insert_deferred() needs a Deferred node policy");
+     if (this->tail) static_cast<Node *>(this->tail)->right = x;
+     else this->head = x;
+     this->tail = x;
+     ++this->cnt;
    }
 
-   Node *clone(Node *x, Node *parent) {
-     if (!x) return nullptr;
-     Node *y = new Node(x->value, parent);
-     y->height = x->height;
-     y->left = clone(x->left, y);
-     y->right = clone(x->right, y);
-     return y;
+   static void setSize(Node *x, size_t cnt, detail::bool_tag<true>) { x->size = cnt; }
+   static void setSize(Node *, size_t, detail::bool_tag<false>) {}
+   static void threadAt(Node *block, size_t i, size_t cnt, detail::bool_tag<true>) {
+     block[i].prev = i ? block + i - 1 : nullptr;
+     block[i].next = i + 1 < cnt ? block + i + 1 : nullptr;
+   }
+   static void threadAt(Node *, size_t, size_t, detail::bool_tag<false>) {}
+
+   // nodes per task in the parallel build
+   static const size_t buildGrain = 1 << 14;
+
+   // link block[lo, lo + cnt), in key order, into the shape buildBalanced gives
+   static Node *linkBlock(Node *block, size_t lo, size_t cnt, Node *parent) {
+     if (!cnt) return nullptr;
+     Node *x = block + lo + cnt / 2;
+     x->setParent(parent);
+     x->left = linkBlock(block, lo, cnt / 2, x);
+     x->right = linkBlock(block, lo + cnt / 2 + 1, cnt - cnt / 2 - 1, x);
+     x->setBal(bits(cnt / 2) - bits(cnt - cnt / 2 - 1));
+     setSize(x, cnt, Sizes());
+     return x;
+   }
+   // the same for the levels above buildGrain; each subtree below is left to
+   // a task, its (lo, cnt) appended to work, and only its root's parent is set
+   static Node *linkTop(Node *block, size_t lo, size_t cnt, Node *parent, size_t *work, size_t &jobs) {
+     if (!cnt) return nullptr;
+     Node *x = block + lo + cnt / 2;
+     x->setParent(parent);
+     if (cnt <= buildGrain) {
+       work[2 * jobs] = lo; work[2 * jobs + 1] = cnt;
+       ++jobs;
+       return x;
+     }
+     x->left = linkTop(block, lo, cnt / 2, x, work, jobs);
+     x->right = linkTop(block, lo + cnt / 2 + 1, cnt - cnt / 2 - 1, x, work, jobs);
+     x->setBal(bits(cnt / 2) - bits(cnt - cnt / 2 - 1));
+     setSize(x, cnt, Sizes());
+     return x;
+   }
+
+   // build cnt distinct, sorted values as one pool block: the values are copied
+   // and the subtrees linked by exec's tasks. nullptr: not possible without a
+   // pool, the caller builds sequentially.
+   template<class RandomIt, class Exec>
+   Node *buildParallel(RandomIt first, size_t cnt, Exec &exec, detail::bool_tag<true>) {
+     size_t tasks = (cnt + buildGrain - 1) / buildGrain;
+     size_t *built = new size_t[tasks]();
+     Node *block;
+     try {
+       block = allocNodes(cnt);
+     } catch (...) {
+       delete[] built;
+       throw;
+     }
+     try {
+       exec.run(tasks, [&](size_t t) {
+         size_t lo = t * buildGrain, hi = cnt - lo < buildGrain ? cnt : lo + buildGrain;
+         for (size_t i = lo; i < hi; ++i) {
+           new (block + i) Node(nullptr, first[i]);
+           threadAt(block, i, cnt, Threads());
+           ++built[t];
+         }
+       });
+     } catch (...) {
+       for (size_t t = 0; t < tasks; ++t)
+         for (size_t i = 0; i < built[t]; ++i) block[t * buildGrain + i].~Node();
+       delete[] built;
+       freeNodes(block, cnt);
+       throw;
+     }
+     delete[] built;
+     // a subtree of at most buildGrain nodes per task; fewer than 2 cnt / grain + 2
+     size_t *work = new size_t[2 * (2 * tasks + 2)];
+     size_t jobs = 0;
+     Node *top = linkTop(block, 0, cnt, nullptr, work, jobs);
+     try {
+       exec.run(jobs, [&](size_t j) {
+         Node *sub = block + work[2 * j] + work[2 * j + 1] / 2;
+         linkBlock(block, work[2 * j], work[2 * j + 1], sub->parent());
+       });
+     } catch (...) {
+       // linking does not throw; only the executor itself can fail here
+       for (size_t j = 0; j < jobs; ++j) {
+         Node *sub = block + work[2 * j] + work[2 * j + 1] / 2;
+         linkBlock(block, work[2 * j], work[2 * j + 1], sub->parent());
+       }
+     }
+     delete[] work;
+     return top;
+   }
+   template<class RandomIt, class Exec>
+   Node *buildParallel(RandomIt, size_t, Exec &, detail::bool_tag<false>) { return nullptr; }
+
+   Node *nodeAt(size_t k) const {
+     Node *cur = root;
+     while (true) {
+       size_t l = sz(cur->left);
+       if (k < l) cur = cur->left;
+       else if (k == l) return cur;
+       else { k -= l + 1; cur = cur->right; }
+     }
+   }
+
+   // up to parts - 1 nodes, in key order, that cut the map into runs of similar
+   // size. with sizes they sit at exact ranks; without, the tallest remaining
+   // subtree is split at its root each time.
+   size_t cutNodes(Node **cuts, size_t parts, detail::bool_tag<true>) const {
+     size_t c = 0;
+     for (size_t i = 1; i < parts; ++i) {
+       size_t r = i * n / parts;
+       if (!r) continue;
+       Node *x = nodeAt(r);
+       if (!c || cuts[c - 1] != x) cuts[c++] = x;
+     }
+     return c;
+   }
+   size_t cutNodes(Node **cuts, size_t parts, detail::bool_tag<false>) const {
+     if (!root || parts < 2) return 0;
+     // piece[i] are the subtrees left between the cuts: cuts[i] lies between
+     // piece[i] and piece[i + 1]
+     Node **piece = new Node *[parts];
+     int *h = new int[parts];
+     size_t m = 1;
+     piece[0] = root; h[0] = height(root);
+     while (m < parts) {
+       size_t j = 0;
+       for (size_t i = 1; i < m; ++i) if (h[i] > h[j]) j = i;
+       if (!h[j]) break;
+       Node *x = piece[j];
+       int hx = h[j];
+       for (size_t i = m; i > j + 1; --i) { piece[i] = piece[i - 1]; h[i] = h[i - 1]; }
+       for (size_t i = m - 1; i > j; --i) cuts[i] = cuts[i - 1];
+       cuts[j] = x;
+       piece[j] = x->left; h[j] = leftHeight(x, hx);
+       piece[j + 1] = x->right; h[j + 1] = rightHeight(x, hx);
+       ++m;
+     }
+     delete[] piece;
+     delete[] h;
+     return m - 1;
+   }
+
+   template<class It>
+   size_t partitionInto(It *out, size_t parts) const {
+     settle();
+     if (!parts) parts = 1;
+     Node **cuts = new Node *[parts];
+     size_t c = cutNodes(cuts, parts, Sizes());
+     out[0] = It(leftmost, this);
+     for (size_t i = 0; i < c; ++i) out[i + 1] = It(cuts[i], this);
+     out[c + 1] = It(nullptr, this);
+     delete[] cuts;
+     return c + 1;
+   }
+
+   // the bounds of a range scan: the first node of [lo, hi) and the first one
+   // past it, one descent each, so that the walk in between compares no keys
+   Node *scanStart(const Key &lo, const Key &hi, Node *&stop) const {
+     if (!comp(lo, hi)) { stop = nullptr; return nullptr; }
+     stop = lowerNode(hi);
+     return lowerNode(lo);
+   }
+   // an in-order walk that keeps the ancestors still to be visited on a stack
+   // of its own instead of climbing parent links (or following threads): the
+   // way on from a leaf then does not wait for the leaf to arrive from memory,
+   // so the cpu runs ahead into the next subtrees and their misses overlap.
+   // the stack holds fewer nodes than the tree is high, and an AVL tree of
+   // 2^64 nodes is 92 high.
+   struct Walk {
+     Node *pend[96];
+     int top = 0;
+     Node *cur = nullptr;
+
+     void start(Node *x) {
+       cur = x;
+       top = 0;
+       if (!x) return;
+       for (Node *a = x, *p = x->parent(); p; a = p, p = p->parent())
+         if (p->left == a) pend[top++] = p;
+       for (int i = 0, j = top - 1; i < j; ++i, --j) { Node *t = pend[i]; pend[i] = pend[j]; pend[j] = t; }
+     }
+     void step() {
+       if (Node *x = cur->right) {
+         while (x->left) { pend[top++] = x; x = x->left; }
+         cur = x;
+       } else {
+         cur = top ? pend[--top] : nullptr;
+       }
+     }
+   };
+
+   template<class V, class F>
+   size_t scanNodes(Node *x, Node *stop, F &fn) const {
+     Walk w;
+     w.start(x);
+     size_t cnt = 0;
+     while (w.cur != stop) {
+       ++cnt;
+       if (!detail::visit(fn, static_cast<V &>(w.cur->value), 0)) break;
+       w.step();
+     }
+     return cnt;
    }
 
   public:
@@ -226,11 +1703,14 @@ template<
 
        iterator(const iterator &other) : cur(other.cur), owner(other.owner) {}
 
+       iterator &operator=(const iterator &other) = default;
+
        /**
     * TODO iter++
         */
        iterator operator++(int) {
          if (!owner) throw invalid_iterator();
+         owner->settle();
          if (cur == nullptr) throw invalid_iterator();
          iterator tmp = *this;
          cur = owner->successor(cur);
@@ -242,6 +1722,7 @@ template<
         */
        iterator &operator++() {
          if (!owner) throw invalid_iterator();
+         owner->settle();
          if (cur == nullptr) throw invalid_iterator();
          cur = owner->successor(cur);
          return *this;
@@ -252,13 +1733,14 @@ template<
         */
        iterator operator--(int) {
          if (!owner) throw invalid_iterator();
+         owner->settle();
          iterator tmp = *this;
          if (cur == nullptr) {
-           if (!owner->root) throw invalid_iterator();
-           cur = owner->maxNode(owner->root);
+           if (!owner->rightmost) throw invalid_iterator();
+           cur = owner->rightmost;
            return tmp;
          }
-         if (cur == owner->minNode(owner->root)) throw invalid_iterator();
+         if (cur == owner->leftmost) throw invalid_iterator();
          cur = owner->predecessor(cur);
          return tmp;
        }
@@ -268,12 +1750,13 @@ template<
         */
        iterator &operator--() {
          if (!owner) throw invalid_iterator();
+         owner->settle();
          if (cur == nullptr) {
-           if (!owner->root) throw invalid_iterator();
-           cur = owner->maxNode(owner->root);
+           if (!owner->rightmost) throw invalid_iterator();
+           cur = owner->rightmost;
            return *this;
          }
-         if (cur == owner->minNode(owner->root)) throw invalid_iterator();
+         if (cur == owner->leftmost) throw invalid_iterator();
          cur = owner->predecessor(cur);
          return *this;
        }
@@ -322,6 +1805,8 @@ template<
 
        const_iterator(const iterator &other) : cur(other.cur), owner(other.owner) {}
 
+       const_iterator &operator=(const const_iterator &other) = default;
+
        const value_type &operator*() const {
          if (!owner || cur == nullptr) throw invalid_iterator();
          return cur->value;
@@ -332,6 +1817,7 @@ template<
        }
        const_iterator operator++(int) {
          if (!owner) throw invalid_iterator();
+         owner->settle();
          if (cur == nullptr) throw invalid_iterator();
          const_iterator tmp = *this;
          cur = owner->successor(cur);
@@ -339,26 +1825,29 @@ template<
        }
        const_iterator &operator++() {
          if (!owner) throw invalid_iterator();
+         owner->settle();
          if (cur == nullptr) throw invalid_iterator();
          cur = owner->successor(cur);
          return *this;
        }
        const_iterator operator--(int) {
          if (!owner) throw invalid_iterator();
+         owner->settle();
          const_iterator tmp = *this;
          if (cur == nullptr) {
-           if (!owner->root) throw invalid_iterator();
-           cur = owner->maxNode(owner->root); return tmp; }
-         if (cur == owner->minNode(owner->root)) throw invalid_iterator();
+           if (!owner->rightmost) throw invalid_iterator();
+           cur = owner->rightmost; return tmp; }
+         if (cur == owner->leftmost) throw invalid_iterator();
          cur = owner->predecessor(cur);
          return tmp;
        }
        const_iterator &operator--() {
          if (!owner) throw invalid_iterator();
+         owner->settle();
          if (cur == nullptr) {
-           if (!owner->root) throw invalid_iterator();
-           cur = owner->maxNode(owner->root); return *this; }
-         if (cur == owner->minNode(owner->root)) throw invalid_iterator();
+           if (!owner->rightmost) throw invalid_iterator();
+           cur = owner->rightmost; return *this; }
+         if (cur == owner->leftmost) throw invalid_iterator();
          cur = owner->predecessor(cur);
          return *this;
        }
@@ -371,32 +1860,138 @@ template<
        friend class map;
    };
 
+   /**
+  * a range read in batches, made by range(lo, hi): next(buf, cap) stores
+  *   pointers to the following (at most cap) elements of [lo, hi) in buf and
+  *   returns how many, 0 once the range is used up.
+  * the cursor takes no checks per element and carries the stack of its walk,
+  *   under 1 KiB; it stays valid only while the map is not modified.
+    */
+   template<class V>
+   class basic_cursor {
+      private:
+       Walk walk;
+       Node *stop = nullptr;
+       basic_cursor(const map *o, const Key &lo, const Key &hi) { walk.start(o->scanStart(lo, hi, stop)); }
+      public:
+       basic_cursor() {}
+
+       size_t next(V **buf, size_t cap) {
+         size_t cnt = 0;
+         for (; cnt < cap && walk.cur != stop; ++cnt) {
+           buf[cnt] = &walk.cur->value;
+           walk.step();
+         }
+         // the first element of the next batch loads while the caller works on this one
+         if (walk.cur != stop) detail::prefetch(walk.cur);
+         return cnt;
+       }
+       bool done() const { return walk.cur == stop; }
+
+       friend class map;
+   };
+   typedef basic_cursor<value_type> cursor;
+   typedef basic_cursor<const value_type> const_cursor;
+
    /**
   * TODO two constructors
     */
    map() {}
 
-   map(const map &other) {
-     root = clone(other.root, nullptr);
-     n = other.n;
-     if (root) {
-       if (root->left) root->left->parent = root;
-       if (root->right) root->right->parent = root;
+   map(const map &other) { copyFrom(other); }
+
+   /**
+  * build from a range of value_type ordered by key (forward iterators).
+  * sorted input is linked into a perfectly balanced tree in O(n); if a
+  *   key is repeated the first one wins. unsorted input is inserted one by one.
+    */
+   template<class ForwardIt>
+   map(ForwardIt first, ForwardIt last) { assign_sorted(first, last); }
+
+   /**
+  * replace the contents with [first, last), see the range constructor.
+    */
+   template<class ForwardIt>
+   void assign_sorted(ForwardIt first, ForwardIt last) {
+     clear();
+     size_t cnt;
+     if (!sortedRange(first, last, cnt)) {
+       insertRun(first, last);
+       return;
+     }
+     if (!cnt) return;
+     Node *head = makeChain(first, last, cnt, Pooled());
+     root = buildBalanced(head, cnt, nullptr);
+     n = cnt;
+     leftmost = minNode(root);
+     rightmost = maxNode(root);
+     rethread(Threads());
+   }
+
+   /**
+  * the same, with the work spread over exec: exec.run(k, task) must call
+  *   task(0) ... task(k - 1), in any order and on any threads, return once all
+  *   of them are done, and then rethrow an exception one of them threw.
+  * the values are copied and the subtrees linked in parallel. this needs the
+  *   pool allocator and distinct keys; otherwise the build is sequential.
+  * thread_executor in parallel_map.hpp is such an executor.
+    */
+   template<class RandomIt, class Exec>
+   void assign_sorted(RandomIt first, RandomIt last, Exec &exec) {
+     clear();
+     size_t cnt;
+     if (!sortedRange(first, last, cnt)) {
+       insertRun(first, last);
+       return;
+     }
+     if (!cnt) return;
+     Node *top = cnt == size_t(last - first) ? buildParallel(first, cnt, exec, Pooled()) : nullptr;
+     if (top) {
+       root = top;
+     } else {
+       Node *head = makeChain(first, last, cnt, Pooled());
+       root = buildBalanced(head, cnt, nullptr);
      }
+     n = cnt;
+     leftmost = minNode(root);
+     rightmost = maxNode(root);
+     if (!top) rethread(Threads());
+   }
+
+   /**
+  * take over the elements of other, leaving it empty.
+  * other gets a fresh allocator, so the two no longer share a pool arena.
+  * iterators into other do not carry over.
+    */
+   map(map &&other)
+     : Comparer(other), Staging(other), root(other.root), leftmost(other.leftmost), rightmost(other.rightmost),
+       n(other.n), alloc(other.alloc) {
+     other.alloc = NodeAllocator();
+     other.root = other.leftmost = other.rightmost = nullptr;
+     other.n = 0;
+     static_cast<Staging &>(other) = Staging();
    }
 
    /**
   * TODO assignment operator
     */
    map &operator=(const map &other) {
+     if (this == &other) return *this;
+     copyFrom(other);
+     return *this;
+   }
+
+   map &operator=(map &&other) {
      if (this == &other) return *this;
      clear();
-     root = clone(other.root, nullptr);
-     n = other.n;
-     if (root) {
-       if (root->left) root->left->parent = root;
-       if (root->right) root->right->parent = root;
-     }
+     alloc = other.alloc;
+     other.alloc = NodeAllocator();
+     compare() = other.compare();
+     static_cast<Staging &>(*this) = other;
+     root = other.root; leftmost = other.leftmost; rightmost = other.rightmost; n = other.n;
+     other.root = other.leftmost = other.rightmost = nullptr;
+     other.n = 0;
+     static_cast<Staging &>(other) = Staging();
      return *this;
    }
 
@@ -430,13 +2025,12 @@ template<
   *   performing an insertion if such key does not already exist.
     */
    T &operator[](const Key &key) {
-     Node *x = findNode(key);
+     Node *parent; bool toLeft;
+     Node *x = findInsertPos(key, parent, toLeft);
      if (x) return x->value.second;
-     value_type v(key, T());
-     bool inserted = false; Node *ins = nullptr;
-     root = insertNode(root, nullptr, v, inserted, &ins);
-     if (root) root->parent = nullptr;
-     return ins->value.second;
+     x = createNode(parent, key, T());
+     linkNode(x, parent, toLeft);
+     return x->value.second;
    }
 
    /**
@@ -451,9 +2045,15 @@ template<
    /**
   * return a iterator to the beginning
     */
-   iterator begin() { return iterator(minNode(root), this); }
+   iterator begin() {
+     settle();
+     return iterator(leftmost, this);
+   }
 
-   const_iterator cbegin() const { return const_iterator(minNode(root), this); }
+   const_iterator cbegin() const {
+     settle();
+     return const_iterator(leftmost, this);
+   }
 
    /**
   * return a iterator to the end
@@ -467,22 +2067,124 @@ template<
   * checks whether the container is empty
   * return true if empty, otherwise false.
     */
-   bool empty() const { return n == 0; }
+   bool empty() const {
+     settle();
+     return n == 0;
+   }
 
    /**
   * returns the number of elements.
     */
-   size_t size() const { return n; }
+   size_t size() const {
+     settle();
+     return n;
+   }
+
+   /**
+  * bytes of node storage each element takes: the value plus the tree links
+  *   the node policy asks for. the pool adds nothing per node on top.
+    */
+   static size_t node_bytes() { return sizeof(Node); }
+
+   /**
+  * what this map has counted so far, for a map with the Counted node policy
+  *   (see node_policy); other maps do not compile a call to it.
+  * copies and moved-to maps start from zero.
+    */
+   map_stats stats() const {
+     static_assert(NodePolicy::counted, "stats() needs a Counted node policy");
+     map_stats res = *this->record();
+     res.comparisons = compare().calls;
+     return res;
+   }
+
+   void reset_stats() {
+     static_assert(NodePolicy::counted, "reset_stats() needs a Counted node policy");
+     *this->record() = map_stats();
+     compare().calls = 0;
+   }
+
+   /**
+  * the memory held for this map: its nodes, what the allocator keeps around
+  *   them (for the pool: free slots and chunk headers of its arena, which maps
+  *   split or merged from this one share), and the heap its keys and values
+  *   own, as payload(value) reports it. other allocators report no slack.
+  * the payload walks every element, O(n); without it, O(1).
+    */
+   template<class F>
+   map_memory memory_usage(F payload) const { return usage(payload, detail::bool_tag<true>()); }
+   /**
+  * the same with heap_bytes<Key> and heap_bytes<T> as the payload, which
+  *   walks the elements only if one of them owns heap memory.
+    */
+   map_memory memory_usage() const {
+     return usage(ownedBytes(), detail::bool_tag<heap_bytes<Key>::owns || heap_bytes<T>::owns>());
+   }
+
+   /**
+  * move the elements into fresh nodes laid out in key order in one block and
+  *   relink them as a balanced tree, then free the old nodes; with the pool,
+  *   an arena no other map shares goes back to the heap whole. afterwards the
+  *   map takes no more memory than its elements need, and a scan walks memory
+  *   in address order.
+  * O(n). every iterator is invalidated. values are moved when that cannot
+  *   throw and copied otherwise, so if copying throws the map is unchanged.
+    */
+   void compact() {
+     settle();
+     if (!n) { clear(); return; }
+     NodeAllocator keep(alloc);
+     renewAllocator(Pooled());
+     Node *head;
+     try {
+       head = makeChain(nodeValues<moveValues>(leftmost), nodeValues<moveValues>(nullptr), n, Pooled());
+     } catch (...) {
+       alloc = keep;
+       throw;
+     }
+     Node *old = root;
+     root = buildBalanced(head, n, nullptr);
+     leftmost = minNode(root);
+     rightmost = maxNode(root);
+     rethread(Threads());
+     dropTree(old, keep, Pooled());
+   }
 
    /**
   * clears the contents
     */
    void clear() {
-     destroy(root);
-     root = nullptr;
+     dropQueue(Defers());
+     destroyAll(Pooled());
+     root = leftmost = rightmost = nullptr;
      n = 0;
    }
 
+   /**
+  * queue value for insertion, only with the Deferred policy (see node_policy):
+  *   O(1), no search and no rebalancing, for bursts of writes that nothing
+  *   reads until they are over.
+  * the queue is placed when the map is next used in any other way, lookups,
+  *   size() and iterator steps included, with the result insert() would have
+  *   given in queue order: a key the map already has, or one queued earlier,
+  *   is dropped. placing m elements sorts them in O(m log m), then inserts
+  *   them one by one if m log n < n, and otherwise merges them with the tree
+  *   and rebuilds it in O(n + m). iterators stay valid.
+  * const calls place the queue too, so a map must not be read from several
+  *   threads while it holds one: call apply_deferred() first. Compare must
+  *   not throw while the queue is placed.
+    */
+   void insert_deferred(const value_type &value) { queueNode(createNode(nullptr, value)); }
+   void insert_deferred(value_type &&value) { queueNode(createNode(nullptr, std::move(value))); }
+
+   /**
+  * place the queued elements now.
+    */
+   void apply_deferred() {
+     static_assert(NodePolicy::deferred, "apply_deferred() needs a Deferred node policy");
+     settle();
+   }
+
    /**
   * insert an element.
   * return a pair, the first of the pair is
@@ -490,10 +2192,114 @@ template<
   *   the second one is true if insert successfully, or false.
     */
    pair<iterator, bool> insert(const value_type &value) {
-     bool inserted = false; Node *ins = nullptr;
-     root = insertNode(root, nullptr, value, inserted, &ins);
-     if (root) root->parent = nullptr;
-     return pair<iterator, bool>(iterator(ins, this), inserted);
+     Timer clock(this->record(), &map_stats::inserts, &map_stats::insert_cycles);
+     bool inserted = false;
+     Node *x = insertNode(value, inserted);
+     return pair<iterator, bool>(iterator(x, this), inserted);
+   }
+
+   /**
+  * same as above, but the element is moved into the map.
+  * if the key already exists, value is left untouched.
+    */
+   pair<iterator, bool> insert(value_type &&value) {
+     Timer clock(this->record(), &map_stats::inserts, &map_stats::insert_cycles);
+     bool inserted = false;
+     Node *x = insertNode(std::move(value), inserted);
+     return pair<iterator, bool>(iterator(x, this), inserted);
+   }
+
+   /**
+  * insert value, searching from hint instead of from the root: the element is
+  *   expected to go right before hint. a right hint costs O(1) amortized, a
+  *   near one O(log d) for d positions off, a wrong one still O(log n).
+  * return the iterator to the new element, or to the one that prevented the insertion.
+  * throw invalid_iterator if hint is not from this map.
+    */
+   iterator insert(const_iterator hint, const value_type &value) {
+     if (hint.owner != this) throw invalid_iterator();
+     Timer clock(this->record(), &map_stats::inserts, &map_stats::insert_cycles);
+     settle();
+     bool inserted;
+     Node *after = hint.cur;
+     return iterator(insertNear(after ? predecessor(after) : rightmost, after, value, inserted), this);
+   }
+
+   iterator insert(const_iterator hint, value_type &&value) {
+     if (hint.owner != this) throw invalid_iterator();
+     Timer clock(this->record(), &map_stats::inserts, &map_stats::insert_cycles);
+     settle();
+     bool inserted;
+     Node *after = hint.cur;
+     return iterator(insertNear(after ? predecessor(after) : rightmost, after, std::move(value), inserted), this);
+   }
+
+   /**
+  * insert every element of [first, last); keys already present are skipped.
+  * each search starts from the element inserted before it, so sorted and nearly
+  *   sorted input costs amortized O(1) per element to place, plus the rebalancing.
+  *   sorted input into an empty map is built directly in O(k), as in assign_sorted.
+    */
+   template<class ForwardIt>
+   void insert(ForwardIt first, ForwardIt last) {
+     settle();
+     if (!root) assign_sorted(first, last);
+     else insertRun(first, last);
+   }
+
+   /**
+  * construct value_type(args...) right inside a new node and insert it.
+  * if the key already exists the new element is destroyed again.
+    */
+   template<class... Args>
+   pair<iterator, bool> emplace(Args &&... args) {
+     Node *x = createNode(nullptr, std::forward<Args>(args)...);
+     Node *parent; bool toLeft;
+     Node *found;
+     try {
+       found = findInsertPos(x->value.first, parent, toLeft);
+     } catch (...) {
+       destroyNode(x);
+       throw;
+     }
+     if (found) {
+       destroyNode(x);
+       return pair<iterator, bool>(iterator(found, this), false);
+     }
+     linkNode(x, parent, toLeft);
+     return pair<iterator, bool>(iterator(x, this), true);
+   }
+
+   /**
+  * insert value_type(key, T(args...)) if key is absent; otherwise do nothing,
+  *   args are not touched and no T is built.
+  * the second of the returned pair tells whether the insertion happened.
+    */
+   template<class... Args>
+   pair<iterator, bool> try_emplace(const Key &key, Args &&... args) {
+     Node *parent; bool toLeft;
+     Node *x = findInsertPos(key, parent, toLeft);
+     if (x) return pair<iterator, bool>(iterator(x, this), false);
+     x = createNode(parent, key, T(std::forward<Args>(args)...));
+     linkNode(x, parent, toLeft);
+     return pair<iterator, bool>(iterator(x, this), true);
+   }
+
+   /**
+  * assign obj to the element with key, or insert value_type(key, obj) if there is none.
+  * the second of the returned pair is true on insertion, false on assignment.
+    */
+   template<class M>
+   pair<iterator, bool> insert_or_assign(const Key &key, M &&obj) {
+     Node *parent; bool toLeft;
+     Node *x = findInsertPos(key, parent, toLeft);
+     if (x) {
+       x->value.second = std::forward<M>(obj);
+       return pair<iterator, bool>(iterator(x, this), false);
+     }
+     x = createNode(parent, key, std::forward<M>(obj));
+     linkNode(x, parent, toLeft);
+     return pair<iterator, bool>(iterator(x, this), true);
    }
 
    /**
@@ -503,10 +2309,147 @@ template<
     */
    void erase(iterator pos) {
      if (pos.owner != this || pos.cur == nullptr) throw invalid_iterator();
-     bool erased = false;
-     root = eraseByNode(root, pos.cur, erased);
-     if (root) root->parent = nullptr;
-     if (!erased) throw invalid_iterator();
+     Timer clock(this->record(), &map_stats::erases, &map_stats::erase_cycles);
+     eraseNode(pos.cur);
+   }
+
+   /**
+  * erase the elements in [first, last) and return last.
+  * a long run costs O(k + log n) for k elements, not O(k log n).
+  * throw invalid_iterator if either iterator is not from this map,
+  *   or first lies after last.
+    */
+   iterator erase(iterator first, iterator last) {
+     if (first.owner != this || last.owner != this) throw invalid_iterator();
+     if (first.cur == last.cur) return last;
+     if (first.cur == nullptr) throw invalid_iterator();
+     if (last.cur && comp(last.cur->value.first, first.cur->value.first)) throw invalid_iterator();
+     eraseRange(first.cur, last.cur);
+     return last;
+   }
+
+   /**
+  * erase the element with key, if any.
+  * returns the number of elements removed (0 or 1).
+    */
+   size_t erase(const Key &key) {
+     Timer clock(this->record(), &map_stats::erases, &map_stats::erase_cycles);
+     Node *x = findNode(key);
+     if (!x) return 0;
+     eraseNode(x);
+     return 1;
+   }
+
+   /**
+  * split off every element whose key is not less than key into a new map.
+  * only pointers are rewired; no element is copied or reallocated.
+  * O(log n) with sized nodes, otherwise O(log n + min(k, n - k)) for
+  *   k moved elements, to count them.
+  * iterators to moved elements are not valid for the returned map.
+  * the returned map allocates from this map's pool arena, which is not
+  *   synchronized: with pool_allocator the two must not be used from
+  *   different threads at the same time.
+    */
+   map split(const Key &key) {
+     map res;
+     res.alloc = alloc;
+     res.compare() = compare();
+     Node *x = lowerNode(key);
+     if (!x) return res;
+     Node *before = predecessor(x);
+     Node *lo, *hi;
+     splitAt(x, lo, hi);
+     size_t cnt = upperCount(lo, hi, n, Sizes());
+     res.root = hi; res.leftmost = x; res.rightmost = rightmost; res.n = cnt;
+     root = lo; rightmost = before; n -= cnt;
+     if (!root) leftmost = nullptr;
+     relinkThreads(before, nullptr, Threads());
+     relinkThreads(nullptr, x, Threads());
+     return res;
+   }
+
+   /**
+  * move every element of other into this map in O(log n); other is left empty.
+  * the keys of the two maps must not interleave: all of other's keys must be
+  *   greater than all of ours, or all of them less.
+  * throw runtime_error (and change nothing) otherwise.
+    */
+   void join(map &&other) {
+     settle();
+     other.settle();
+     if (&other == this || !other.root) return;
+     if (!root) { *this = static_cast<map &&>(other); return; }
+     map *lo, *hi;
+     if (comp(rightmost->value.first, other.leftmost->value.first)) { lo = this; hi = &other; }
+     else if (comp(other.rightmost->value.first, leftmost->value.first)) { lo = &other; hi = this; }
+     else throw runtime_error();
+     shareAllocator(other, Pooled());
+     relinkThreads(lo->rightmost, hi->leftmost, Threads());
+     Node *l = lo->leftmost, *r = hi->rightmost;
+     root = joinTrees(lo->root, hi->root);
+     leftmost = l; rightmost = r;
+     n += other.n;
+     other.root = other.leftmost = other.rightmost = nullptr;
+     other.n = 0;
+   }
+
+   /**
+  * move the elements of other whose keys are not in this map yet over here,
+  *   relinking their nodes: nothing is copied or reallocated. elements with
+  *   keys we already have stay in other.
+  * key-disjoint ranges are joined in O(log n), otherwise each moved element
+  *   costs one descent.
+    */
+   void merge(map &other) {
+     settle();
+     other.settle();
+     if (&other == this || !other.root) return;
+     if (!root || comp(rightmost->value.first, other.leftmost->value.first)
+         || comp(other.rightmost->value.first, leftmost->value.first)) {
+       join(static_cast<map &&>(other));
+       return;
+     }
+     shareAllocator(other, Pooled());
+     for (Node *x = other.leftmost; x; ) {
+       Node *nx = successor(x);
+       Node *parent; bool toLeft;
+       if (!findInsertPos(x->value.first, parent, toLeft)) {
+         other.unlinkNode(x);
+         x->left = x->right = nullptr;
+         x->setBal(0);
+         updSize(x, Sizes());
+         linkNode(x, parent, toLeft);
+       }
+       x = nx;
+     }
+   }
+
+   /**
+  * batched lookup: write find(k) for every key k of [first, last) to out, in
+  *   order, and return the advanced out. several descents are interleaved with
+  *   prefetching, so their cache misses overlap instead of queuing up.
+  * the keys must be lvalues (forward iterators); with a transparent Compare
+  *   they may be of any type a lookup accepts.
+    */
+   template<class ForwardIt, class OutputIt>
+   OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+     findBatch(first, last, [&](Node *x) { *out = iterator(x, this); ++out; });
+     return out;
+   }
+   template<class ForwardIt, class OutputIt>
+   OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+     findBatch(first, last, [&](Node *x) { *out = const_iterator(x, this); ++out; });
+     return out;
+   }
+
+   /**
+  * batched count: write count(k) (0 or 1) for every key k of [first, last)
+  *   to out, in order, as find_batch does.
+    */
+   template<class ForwardIt, class OutputIt>
+   OutputIt count_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+     findBatch(first, last, [&](Node *x) { *out = size_t(x ? 1 : 0); ++out; });
+     return out;
    }
 
    /**
@@ -525,10 +2468,162 @@ template<
   *   If no such element is found, past-the-end (see end()) iterator is returned.
     */
    iterator find(const Key &key) {
+     Timer clock(this->record(), &map_stats::finds, &map_stats::find_cycles);
      return iterator(findNode(key), this);
    }
 
-   const_iterator find(const Key &key) const { return const_iterator(findNode(key), this); }
+   const_iterator find(const Key &key) const {
+     Timer clock(this->record(), &map_stats::finds, &map_stats::find_cycles);
+     return const_iterator(findNode(key), this);
+   }
+
+   /**
+  * iterator to the first element whose key is not less than key,
+  *   or end() if there is none.
+    */
+   iterator lower_bound(const Key &key) { return iterator(lowerNode(key), this); }
+   const_iterator lower_bound(const Key &key) const { return const_iterator(lowerNode(key), this); }
+
+   /**
+  * iterator to the first element whose key is greater than key,
+  *   or end() if there is none.
+    */
+   iterator upper_bound(const Key &key) { return iterator(upperNode(key), this); }
+   const_iterator upper_bound(const Key &key) const { return const_iterator(upperNode(key), this); }
+
+   /**
+  * the range of elements with key: [lower_bound(key), upper_bound(key)).
+    */
+   pair<iterator, iterator> equal_range(const Key &key) {
+     Node *x = lowerNode(key);
+     Node *y = x && !comp(key, x->value.first) ? successor(x) : x;
+     return pair<iterator, iterator>(iterator(x, this), iterator(y, this));
+   }
+   pair<const_iterator, const_iterator> equal_range(const Key &key) const {
+     Node *x = lowerNode(key);
+     Node *y = x && !comp(key, x->value.first) ? successor(x) : x;
+     return pair<const_iterator, const_iterator>(const_iterator(x, this), const_iterator(y, this));
+   }
+
+   /**
+  * heterogeneous lookup: with a transparent Compare (one that declares
+  *   is_transparent, e.g. std::less<>) these also take any K that Compare can
+  *   order against Key, so probing needs no temporary Key.
+    */
+   template<class K>
+   typename detail::if_transparent<Compare, K, T &>::type at(const K &key) {
+     Node *x = findNode(key);
+     if (!x) throw index_out_of_bound();
+     return x->value.second;
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, const T &>::type at(const K &key) const {
+     Node *x = findNode(key);
+     if (!x) throw index_out_of_bound();
+     return x->value.second;
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, size_t>::type count(const K &key) const { return findNode(key) ? 1 : 0; }
+   template<class K>
+   typename detail::if_transparent<Compare, K, iterator>::type find(const K &key) { return iterator(findNode(key), this); }
+   template<class K>
+   typename detail::if_transparent<Compare, K, const_iterator>::type find(const K &key) const {
+     return const_iterator(findNode(key), this);
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, iterator>::type lower_bound(const K &key) { return iterator(lowerNode(key), this); }
+   template<class K>
+   typename detail::if_transparent<Compare, K, const_iterator>::type lower_bound(const K &key) const {
+     return const_iterator(lowerNode(key), this);
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, iterator>::type upper_bound(const K &key) { return iterator(upperNode(key), this); }
+   template<class K>
+   typename detail::if_transparent<Compare, K, const_iterator>::type upper_bound(const K &key) const {
+     return const_iterator(upperNode(key), this);
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, pair<iterator, iterator> >::type equal_range(const K &key) {
+     Node *x = lowerNode(key);
+     Node *y = x && !comp(key, x->value.first) ? successor(x) : x;
+     return pair<iterator, iterator>(iterator(x, this), iterator(y, this));
+   }
+   template<class K>
+   typename detail::if_transparent<Compare, K, pair<const_iterator, const_iterator> >::type equal_range(const K &key) const {
+     Node *x = lowerNode(key);
+     Node *y = x && !comp(key, x->value.first) ? successor(x) : x;
+     return pair<const_iterator, const_iterator>(const_iterator(x, this), const_iterator(y, this));
+   }
+
+   /**
+  * cut the map into at most parts consecutive runs of similar size, e.g. to
+  *   hand them to different threads. out receives k + 1 iterators, begin()
+  *   first and end() last, and run i is [out[i], out[i + 1]); returns k.
+  * the cuts are roots of the tallest subtrees, so the runs are only roughly
+  *   even; with sized nodes they sit at exact ranks. O(parts^2 + parts log n).
+  * out must have room for parts + 1 iterators.
+    */
+   size_t partition(iterator *out, size_t parts) { return partitionInto(out, parts); }
+   size_t partition(const_iterator *out, size_t parts) const { return partitionInto(out, parts); }
+
+   /**
+  * range scan: fn(element) for the elements whose keys lie in [lo, hi), in
+  *   key order, and return how many were visited. fn may return bool, and
+  *   false stops the scan after that element. one descent finds each bound and
+  *   the walk in between takes no checks; on nodes scattered over memory it
+  *   runs several times faster than lower_bound plus ++.
+  * fn may change mapped values but must not modify the map.
+    */
+   template<class F>
+   size_t scan(const Key &lo, const Key &hi, F fn) {
+     Node *stop, *x = scanStart(lo, hi, stop);
+     return scanNodes<value_type>(x, stop, fn);
+   }
+   template<class F>
+   size_t scan(const Key &lo, const Key &hi, F fn) const {
+     Node *stop, *x = scanStart(lo, hi, stop);
+     return scanNodes<const value_type>(x, stop, fn);
+   }
+
+   /**
+  * the elements of [lo, hi) as a cursor, to read them in batches of pointers
+  *   into a buffer of the caller's (see basic_cursor).
+    */
+   cursor range(const Key &lo, const Key &hi) { return cursor(this, lo, hi); }
+   const_cursor range(const Key &lo, const Key &hi) const { return const_cursor(this, lo, hi); }
+
+   /**
+  * order statistics, only with sized nodes (see node_policy).
+  * rank: the number of elements whose key is less than key.
+  * select: iterator to the element at position k in key order (0-based),
+  *   throw index_out_of_bound if k >= size().
+  * index_of: position of pos in key order, size() for end(); the distance
+  *   between two iterators is the difference of their indices.
+  * all of them are O(log n).
+    */
+   size_t rank(const Key &key) const {
+     static_assert(NodePolicy::sized, "rank() needs sized nodes");
+     settle();
+     size_t res = 0;
+     for (Node *cur = root; cur; ) {
+       if (comp(cur->value.first, key)) { res += sz(cur->left) + 1; cur = cur->right; }
+       else cur = cur->left;
+     }
+     return res;
+   }
+   iterator select(size_t k) {
+     static_assert(NodePolicy::sized, "select() needs sized nodes");
+     settle();
+     if (k >= n) throw index_out_of_bound();
+     return iterator(nodeAt(k), this);
+   }
+   const_iterator select(size_t k) const { return const_cast<map *>(this)->select(k); }
+   size_t index_of(const const_iterator &pos) const {
+     static_assert(NodePolicy::sized, "index_of() needs sized nodes");
+     if (pos.owner != this) throw invalid_iterator();
+     settle();
+     return pos.cur ? indexOf(pos.cur) : n;
+   }
 };
 
 }
@@ -0,0 +1,435 @@
+/**
+ * binary images of sjtu::map, for restarts that do not rebuild a map one
+ * insert at a time.
+ *
+ * save(out, m) writes a header and the elements in key order; load(in, m)
+ * reads them back and builds the tree with map::assign_sorted(), in linear
+ * time. the tree shape is not stored: assign_sorted() makes the same balanced
+ * tree out of n sorted elements every time, so the image holds no pointers
+ * and can be loaded at any address.
+ *
+ * elements go through image_codec<U>. trivially copyable types are raw bytes,
+ * and a map whose key and value are both trivially copyable is written as one
+ * block of keys and one block of values at fixed offsets. std::string is its
+ * length and characters; specialize image_codec for other types.
+ *
+ * map_image maps a file holding such blocks into memory and answers lookups
+ * from the key block directly, without reading or building anything;
+ * load(image, m) turns it into a map.
+ *
+ * images use the byte order and type sizes of the machine that wrote them;
+ * a mismatch is detected and rejected.
+ *
+ * not part of the OJ submission; map.hpp does not depend on this file.
+ */
+#ifndef SJTU_MAP_IMAGE_HPP
+#define SJTU_MAP_IMAGE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <new>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "map.hpp"
+
+namespace sjtu {
+
+/**
+ * how one key or value is written. raw codecs have a fixed size and are
+ * copied as bytes; the others read and write single objects.
+ */
+template<class U, class = void>
+struct image_codec;
+
+template<class U>
+struct image_codec<U, typename std::enable_if<std::is_trivially_copyable<U>::value>::type> {
+  static const bool raw = true;
+  static void write(std::ostream &out, const U &x) { out.write(reinterpret_cast<const char *>(&x), sizeof(U)); }
+  static U read(std::istream &in) {
+    U x;
+    in.read(reinterpret_cast<char *>(&x), sizeof(U));
+    return x;
+  }
+};
+
+template<>
+struct image_codec<std::string> {
+  static const bool raw = false;
+  static void write(std::ostream &out, const std::string &s) {
+    std::uint64_t len = s.size();
+    out.write(reinterpret_cast<const char *>(&len), sizeof(len));
+    out.write(s.data(), s.size());
+  }
+  static std::string read(std::istream &in) {
+    std::uint64_t len = 0;
+    in.read(reinterpret_cast<char *>(&len), sizeof(len));
+    std::string s;
+    // grow with what actually arrives, so a corrupt length fails the read
+    // instead of allocating it up front
+    char buf[4096];
+    while (in && len) {
+      size_t part = len < sizeof(buf) ? size_t(len) : sizeof(buf);
+      in.read(buf, part);
+      s.append(buf, size_t(in.gcount()));
+      len -= part;
+    }
+    return s;
+  }
+};
+
+namespace detail {
+
+struct image_header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t order;        // 0x01020304 as the writer stores it
+  std::uint32_t key_size;     // sizeof(Key) for the block layout, 0 for records
+  std::uint32_t value_size;
+  std::uint64_t count;
+};
+
+const char image_magic[8] = {'s', 'j', 't', 'u', 'm', 'a', 'p', 0};
+const std::uint32_t image_version = 1;
+const std::uint32_t image_order = 0x01020304;
+
+// the block layout: keys at keys_at, values at the next multiple of block_align
+const size_t image_block_align = 64;
+const size_t image_keys_at = image_block_align;
+
+inline size_t image_values_at(size_t cnt, size_t keySize) {
+  return (image_keys_at + cnt * keySize + image_block_align - 1) / image_block_align * image_block_align;
+}
+
+template<class Key, class T>
+struct image_layout {
+  static const bool blocks = image_codec<Key>::raw && image_codec<T>::raw;
+};
+
+template<class Key, class T>
+image_header make_header(size_t cnt) {
+  image_header h;
+  std::memcpy(h.magic, image_magic, sizeof(h.magic));
+  h.version = image_version;
+  h.order = image_order;
+  h.key_size = image_layout<Key, T>::blocks ? sizeof(Key) : 0;
+  h.value_size = image_layout<Key, T>::blocks ? sizeof(T) : 0;
+  h.count = cnt;
+  return h;
+}
+
+template<class Key, class T>
+bool header_fits(const image_header &h) {
+  return !std::memcmp(h.magic, image_magic, sizeof(h.magic)) && h.version == image_version &&
+         h.order == image_order && h.key_size == (image_layout<Key, T>::blocks ? sizeof(Key) : 0) &&
+         h.value_size == (image_layout<Key, T>::blocks ? sizeof(T) : 0);
+}
+
+inline void pad(std::ostream &out, size_t from, size_t to) {
+  static const char zeros[image_block_align] = {};
+  if (to > from) out.write(zeros, to - from);
+}
+
+// walks a key block and a value block side by side, handing out pairs of
+// references; a forward iterator for map::assign_sorted
+template<class Key, class T>
+class image_cursor {
+  private:
+   const Key *k;
+   const T *v;
+
+  public:
+   typedef std::forward_iterator_tag iterator_category;
+   typedef pair<const Key &, const T &> value_type;
+   typedef std::ptrdiff_t difference_type;
+   typedef const value_type *pointer;
+   typedef value_type reference;
+
+   image_cursor(const Key *k, const T *v) : k(k), v(v) {}
+
+   reference operator*() const { return reference(*k, *v); }
+   image_cursor &operator++() {
+     ++k;
+     ++v;
+     return *this;
+   }
+   image_cursor operator++(int) {
+     image_cursor tmp = *this;
+     ++*this;
+     return tmp;
+   }
+   bool operator==(const image_cursor &rhs) const { return k == rhs.k; }
+   bool operator!=(const image_cursor &rhs) const { return k != rhs.k; }
+};
+
+template<class U>
+struct raw_block {
+  U *p;
+  explicit raw_block(size_t cnt) : p(cnt ? static_cast<U *>(::operator new(cnt * sizeof(U))) : nullptr) {}
+  ~raw_block() { ::operator delete(p); }
+  raw_block(const raw_block &) = delete;
+  raw_block &operator=(const raw_block &) = delete;
+};
+
+// copies raw objects into a buffer and writes it out whole, instead of one
+// stream call per element
+class block_writer {
+  private:
+   std::ostream &out;
+   char buf[1 << 14];
+   size_t used = 0;
+
+  public:
+   explicit block_writer(std::ostream &out) : out(out) {}
+   template<class U>
+   void put(const U &x) {
+     if (sizeof(buf) - used < sizeof(U)) flush();
+     std::memcpy(buf + used, &x, sizeof(U));
+     used += sizeof(U);
+   }
+   void flush() {
+     out.write(buf, used);
+     used = 0;
+   }
+};
+
+template<class Key, class T, class Compare, class Alloc, class Policy>
+void save_blocks(std::ostream &out, const map<Key, T, Compare, Alloc, Policy> &m, bool_tag<true>) {
+  static_assert(sizeof(Key) <= 1 << 14 && sizeof(T) <= 1 << 14, "raw objects larger than the write buffer");
+  typedef typename map<Key, T, Compare, Alloc, Policy>::const_iterator It;
+  // one walk over the tree: the keys go out as they come, the values wait
+  raw_block<T> vals(m.size());
+  block_writer w(out);
+  pad(out, sizeof(image_header), image_keys_at);
+  size_t i = 0;
+  for (It it = m.cbegin(); it != m.cend(); ++it, ++i) {
+    w.put(it->first);
+    std::memcpy(static_cast<void *>(vals.p + i), &it->second, sizeof(T));
+  }
+  w.flush();
+  pad(out, image_keys_at + m.size() * sizeof(Key), image_values_at(m.size(), sizeof(Key)));
+  out.write(reinterpret_cast<const char *>(vals.p), m.size() * sizeof(T));
+}
+
+template<class Key, class T, class Compare, class Alloc, class Policy>
+void save_blocks(std::ostream &out, const map<Key, T, Compare, Alloc, Policy> &m, bool_tag<false>) {
+  typedef typename map<Key, T, Compare, Alloc, Policy>::const_iterator It;
+  for (It it = m.cbegin(); it != m.cend(); ++it) {
+    image_codec<Key>::write(out, it->first);
+    image_codec<T>::write(out, it->second);
+  }
+}
+
+inline void skip(std::istream &in, size_t cnt) {
+  char buf[image_block_align];
+  while (in && cnt) {
+    size_t part = cnt < sizeof(buf) ? cnt : sizeof(buf);
+    in.read(buf, part);
+    cnt -= part;
+  }
+}
+
+template<class Key, class T, class Compare, class Alloc, class Policy>
+void load_blocks(std::istream &in, size_t cnt, map<Key, T, Compare, Alloc, Policy> &m, bool_tag<true>) {
+  if (cnt > size_t(-1) / 2 / (sizeof(Key) + sizeof(T))) throw runtime_error();
+  raw_block<Key> keys(cnt);
+  raw_block<T> vals(cnt);
+  skip(in, image_keys_at - sizeof(image_header));
+  in.read(reinterpret_cast<char *>(keys.p), cnt * sizeof(Key));
+  skip(in, image_values_at(cnt, sizeof(Key)) - image_keys_at - cnt * sizeof(Key));
+  in.read(reinterpret_cast<char *>(vals.p), cnt * sizeof(T));
+  if (!in) throw runtime_error();
+  m.assign_sorted(image_cursor<Key, T>(keys.p, vals.p), image_cursor<Key, T>(keys.p + cnt, vals.p + cnt));
+}
+
+template<class Key, class T, class Compare, class Alloc, class Policy>
+void load_blocks(std::istream &in, size_t cnt, map<Key, T, Compare, Alloc, Policy> &m, bool_tag<false>) {
+  std::vector<pair<Key, T> > elems;
+  // the count is only a hint until the records have arrived
+  elems.reserve(cnt < (size_t(1) << 20) ? cnt : size_t(1) << 20);
+  for (size_t i = 0; i < cnt; ++i) {
+    Key k = image_codec<Key>::read(in);
+    T v = image_codec<T>::read(in);
+    if (!in) throw runtime_error();
+    elems.push_back(pair<Key, T>(std::move(k), std::move(v)));
+  }
+  m.assign_sorted(std::make_move_iterator(elems.begin()), std::make_move_iterator(elems.end()));
+}
+
+}
+
+/**
+ * write m to out as an image. throw runtime_error if out fails.
+ */
+template<class Key, class T, class Compare, class Alloc, class Policy>
+void save(std::ostream &out, const map<Key, T, Compare, Alloc, Policy> &m) {
+  detail::image_header h = detail::make_header<Key, T>(m.size());
+  out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  detail::save_blocks(out, m, detail::bool_tag<detail::image_layout<Key, T>::blocks>());
+  if (!out) throw runtime_error();
+}
+
+/**
+ * replace the contents of m with the image read from in.
+ * throw runtime_error if the stream fails or does not hold an image of this
+ *   key and value type; m is left empty then.
+ */
+template<class Key, class T, class Compare, class Alloc, class Policy>
+void load(std::istream &in, map<Key, T, Compare, Alloc, Policy> &m) {
+  m.clear();
+  detail::image_header h;
+  if (!in.read(reinterpret_cast<char *>(&h), sizeof(h)) || !detail::header_fits<Key, T>(h)) throw runtime_error();
+  if (h.count != size_t(h.count)) throw runtime_error();
+  detail::load_blocks(in, size_t(h.count), m, detail::bool_tag<detail::image_layout<Key, T>::blocks>());
+}
+
+/**
+ * a saved image of a map with trivially copyable key and value, mapped
+ * read-only into memory. lookups binary search the key block in place;
+ * nothing is read until a page is touched.
+ */
+template<class Key, class T, class Compare = std::less<Key> >
+class map_image {
+  static_assert(detail::image_layout<Key, T>::blocks, "map_image needs trivially copyable keys and values");
+  static_assert(alignof(Key) <= detail::image_block_align && alignof(T) <= detail::image_block_align,
+                "over-aligned types do not fit the image blocks");
+
+  private:
+   void *base = nullptr;
+   size_t bytes = 0;
+   const Key *keys = nullptr;
+   const T *vals = nullptr;
+   size_t n = 0;
+   Compare comp = Compare();
+
+   void unmap() {
+     if (base) munmap(base, bytes);
+     base = nullptr;
+     bytes = 0;
+     keys = nullptr;
+     vals = nullptr;
+     n = 0;
+   }
+
+   size_t lowerIndex(const Key &key) const {
+     if (!n) return 0;
+     const Key *at = keys;
+     size_t len = n;
+     while (len > 1) {
+       size_t half = len >> 1;
+       at = comp(at[half], key) ? at + half : at;
+       len -= half;
+     }
+     return (at - keys) + comp(*at, key);
+   }
+   size_t findIndex(const Key &key) const {
+     size_t i = lowerIndex(key);
+     return i < n && !comp(key, keys[i]) ? i : n;
+   }
+
+  public:
+   /**
+  * map the image saved in the file at path.
+  * throw runtime_error if the file cannot be mapped or is not an image of
+  *   this key and value type.
+    */
+   explicit map_image(const char *path) {
+     int fd = open(path, O_RDONLY);
+     if (fd < 0) throw runtime_error();
+     struct stat st;
+     if (fstat(fd, &st) || size_t(st.st_size) < sizeof(detail::image_header)) {
+       close(fd);
+       throw runtime_error();
+     }
+     bytes = size_t(st.st_size);
+     base = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+     close(fd);
+     if (base == MAP_FAILED) {
+       base = nullptr;
+       throw runtime_error();
+     }
+     detail::image_header h;
+     std::memcpy(&h, base, sizeof(h));
+     size_t cnt = size_t(h.count);
+     if (!detail::header_fits<Key, T>(h) || cnt != h.count || cnt > bytes / sizeof(Key) ||
+         bytes < detail::image_values_at(cnt, sizeof(Key)) ||
+         (bytes - detail::image_values_at(cnt, sizeof(Key))) / sizeof(T) < cnt) {
+       unmap();
+       throw runtime_error();
+     }
+     const unsigned char *at = static_cast<const unsigned char *>(base);
+     keys = reinterpret_cast<const Key *>(at + detail::image_keys_at);
+     vals = reinterpret_cast<const T *>(at + detail::image_values_at(cnt, sizeof(Key)));
+     n = cnt;
+   }
+
+   map_image(map_image &&other)
+     : base(other.base), bytes(other.bytes), keys(other.keys), vals(other.vals), n(other.n), comp(other.comp) {
+     other.base = nullptr;
+     other.unmap();
+   }
+   map_image &operator=(map_image &&other) {
+     if (this == &other) return *this;
+     unmap();
+     base = other.base; bytes = other.bytes; keys = other.keys; vals = other.vals; n = other.n;
+     comp = other.comp;
+     other.base = nullptr;
+     other.unmap();
+     return *this;
+   }
+   map_image(const map_image &) = delete;
+   map_image &operator=(const map_image &) = delete;
+
+   ~map_image() { unmap(); }
+
+   /**
+  * the mapped value of key.
+  * throw index_out_of_bound if the key is absent.
+    */
+   const T &at(const Key &key) const {
+     size_t i = findIndex(key);
+     if (i == n) throw index_out_of_bound();
+     return vals[i];
+   }
+   const T &operator[](const Key &key) const { return at(key); }
+
+   size_t count(const Key &key) const { return findIndex(key) < n ? 1 : 0; }
+
+   /**
+  * the mapped value of key, or nullptr.
+    */
+   const T *find(const Key &key) const {
+     size_t i = findIndex(key);
+     return i < n ? vals + i : nullptr;
+   }
+
+   bool empty() const { return n == 0; }
+   size_t size() const { return n; }
+
+   /**
+  * the blocks themselves: size() keys in order and their values.
+    */
+   const Key *key_data() const { return keys; }
+   const T *value_data() const { return vals; }
+};
+
+/**
+ * replace the contents of m with the elements of image, in linear time.
+ */
+template<class Key, class T, class Compare, class Alloc, class Policy>
+void load(const map_image<Key, T, Compare> &image, map<Key, T, Compare, Alloc, Policy> &m) {
+  const Key *k = image.key_data();
+  const T *v = image.value_data();
+  m.assign_sorted(detail::image_cursor<Key, T>(k, v), detail::image_cursor<Key, T>(k + image.size(), v + image.size()));
+}
+
+}
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * multi-threaded passes over sjtu::map.
+ *
+ * parallel_for_each and map_reduce cut the map with map::partition() into a
+ * few runs per thread and walk the runs on a thread_executor; the parallel
+ * bulk build goes through map::assign_sorted(first, last, exec).
+ *
+ * the map must not be modified by anyone else while one of these runs.
+ *
+ * not part of the OJ submission; map.hpp does not depend on this file.
+ */
+#ifndef SJTU_PARALLEL_MAP_HPP
+#define SJTU_PARALLEL_MAP_HPP
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "map.hpp"
+
+namespace sjtu {
+
+/**
+ * runs the tasks of one parallel step on the calling thread and threads - 1
+ * helpers started for the step. tasks are handed out one at a time from a
+ * shared counter, so a thread that is done with a short task simply takes the
+ * next one; uneven tasks balance out as long as there are several per thread.
+ * after a task throws, the tasks not started yet are skipped and run()
+ * rethrows the first exception once every thread has stopped.
+ */
+class thread_executor {
+  private:
+   unsigned threads;
+
+  public:
+   /**
+  * threads == 0: one per hardware thread.
+    */
+   explicit thread_executor(unsigned threads = 0) : threads(threads) {
+     if (!this->threads) this->threads = std::thread::hardware_concurrency();
+     if (!this->threads) this->threads = 1;
+   }
+
+   unsigned concurrency() const { return threads; }
+
+   template<class F>
+   void run(size_t count, F task) {
+     std::atomic<size_t> next{0};
+     std::atomic<bool> failed{false};
+     std::exception_ptr error;
+     std::mutex errorLock;
+     auto work = [&] {
+       for (size_t i; !failed.load(std::memory_order_relaxed) && (i = next.fetch_add(1)) < count;) {
+         try {
+           task(i);
+         } catch (...) {
+           std::lock_guard<std::mutex> hold(errorLock);
+           if (!error) error = std::current_exception();
+           failed = true;
+         }
+       }
+     };
+     size_t helpers = count > threads ? threads - 1 : count ? count - 1 : 0;
+     std::vector<std::thread> pool;
+     try {
+       pool.reserve(helpers);
+       for (size_t i = 0; i < helpers; ++i) pool.emplace_back(work);
+     } catch (...) {
+       failed = true;
+       for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+       throw;
+     }
+     work();
+     for (size_t i = 0; i < pool.size(); ++i) pool[i].join();
+     if (error) std::rethrow_exception(error);
+   }
+};
+
+namespace detail {
+
+// runs per thread; more than one, so that uneven runs still even out
+const size_t runs_per_thread = 8;
+
+template<class Map> struct run_iterator { typedef typename Map::iterator type; };
+template<class Map> struct run_iterator<const Map> { typedef typename Map::const_iterator type; };
+
+template<class Map>
+std::vector<typename run_iterator<Map>::type> cut_runs(Map &m, const thread_executor &exec) {
+  size_t parts = exec.concurrency() > 1 ? exec.concurrency() * runs_per_thread : 1;
+  std::vector<typename run_iterator<Map>::type> cuts(parts + 1);
+  cuts.resize(m.partition(cuts.data(), parts) + 1);
+  return cuts;
+}
+
+}
+
+/**
+ * call fn(element) for every element of m on threads threads (0: one per
+ * hardware thread). a non-const map hands out value_type &, so fn may change
+ * the mapped values. fn runs concurrently on different elements; the order
+ * of calls is unspecified.
+ */
+template<class Map, class F>
+void parallel_for_each(Map &m, F fn, unsigned threads = 0) {
+  thread_executor exec(threads);
+  auto cuts = detail::cut_runs(m, exec);
+  exec.run(cuts.size() - 1, [&](size_t i) {
+    for (auto it = cuts[i]; it != cuts[i + 1]; ++it) fn(*it);
+  });
+}
+
+/**
+ * reduce(... reduce(reduce(identity, mapper(e0)), mapper(e1)) ..., mapper(en))
+ * over the elements in key order, with the runs of the map reduced on
+ * different threads and their results combined in order. reduce must be
+ * associative with identity as its neutral element; it need not commute.
+ */
+template<class Map, class R, class Mapper, class Reducer>
+R map_reduce(const Map &m, Mapper mapper, R identity, Reducer reduce, unsigned threads = 0) {
+  thread_executor exec(threads);
+  auto cuts = detail::cut_runs(m, exec);
+  // one result per run, wrapped so that R = bool does not pick vector<bool>
+  struct Part { R value; };
+  std::vector<Part> part(cuts.size() - 1, Part{identity});
+  exec.run(part.size(), [&](size_t i) {
+    R acc = identity;
+    for (auto it = cuts[i]; it != cuts[i + 1]; ++it) acc = reduce(acc, mapper(*it));
+    part[i].value = acc;
+  });
+  R res = identity;
+  for (size_t i = 0; i < part.size(); ++i) res = reduce(res, part[i].value);
+  return res;
+}
+
+/**
+ * m.assign_sorted(first, last) with the values copied and the tree linked on
+ * threads threads.
+ */
+template<class Map, class RandomIt>
+void parallel_assign_sorted(Map &m, RandomIt first, RandomIt last, unsigned threads = 0) {
+  thread_executor exec(threads);
+  m.assign_sorted(first, last, exec);
+}
+
+}
+
+#endif
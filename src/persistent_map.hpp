@@ -0,0 +1,490 @@
+/**
+ * a map whose copies share structure: copying is O(1), and a write copies
+ * only the nodes it touches.
+ *
+ * every node counts the links to it (from parent nodes and from map
+ * objects). a write walks down from the root and makes each node on its path
+ * private to this map first, copying it when another version still holds
+ * it; nodes held by this map alone are changed in place. so a fresh copy
+ * pays O(log n) node copies for its first write at each place, and memory
+ * grows with the edits rather than with the size of every version.
+ *
+ * the interface follows sjtu::map, except that iteration is read-only:
+ * elements are changed through operator[], at() or insert_or_assign(). an
+ * iterator belongs to one version and stays valid until that version is
+ * written to; writes to other copies never affect it.
+ *
+ * the counts are plain integers: versions sharing nodes must not be used
+ * from different threads at the same time. value_type must be
+ * copy-constructible.
+ *
+ * not part of the OJ submission; map.hpp does not depend on this file.
+ */
+#ifndef SJTU_PERSISTENT_MAP_HPP
+#define SJTU_PERSISTENT_MAP_HPP
+
+#include "map.hpp"
+
+namespace sjtu {
+
+template<
+   class Key,
+   class T,
+   class Compare = std::less<Key>,
+   class Allocator = pool_allocator<pair<const Key, T> >
+   > class persistent_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+  private:
+   struct Node {
+     value_type value;
+     Node *left;
+     Node *right;
+     size_t refs = 1;
+     int height = 1;
+     template<class... Args>
+     Node(Node *l, Node *r, Args &&... args) : value(std::forward<Args>(args)...), left(l), right(r) {}
+   };
+
+   // AVL height bound for any tree that fits in memory (2^44 nodes need < 64)
+   static const int maxHeight = 64;
+
+   // all versions made from one map by copying share this allocator's arena,
+   // so a node may be freed through any of them
+   typedef typename detail::rebind_alloc<Allocator, Node>::type NodeAllocator;
+
+   Node *root = nullptr;
+   size_t n = 0;
+   Compare comp = Compare();
+   NodeAllocator alloc;
+
+   static int height(Node *x) { return x ? x->height : 0; }
+   static void fix(Node *x) { x->height = 1 + (height(x->left) > height(x->right) ? height(x->left) : height(x->right)); }
+
+   template<class... Args>
+   Node *make(Node *l, Node *r, Args &&... args) {
+     Node *x = alloc.allocate(1);
+     try {
+       new (x) Node(l, r, std::forward<Args>(args)...);
+     } catch (...) {
+       alloc.deallocate(x, 1);
+       throw;
+     }
+     return x;
+   }
+
+   void freeNode(Node *x) {
+     x->~Node();
+     alloc.deallocate(x, 1);
+   }
+
+   // drop one link to x; whatever nobody links to any more is freed
+   void release(Node *x) {
+     while (x && --x->refs == 0) {
+       release(x->left);
+       Node *r = x->right;
+       freeNode(x);
+       x = r;
+     }
+   }
+
+   // x, made private to this map: itself when nothing else links to it,
+   // otherwise a copy holding x's children, with x giving up the link. the
+   // caller must store the result where x was linked right away, so that the
+   // counts are right again before anything else can throw.
+   Node *own(Node *x) {
+     if (!x || x->refs == 1) return x;
+     Node *y = make(x->left, x->right, x->value);
+     y->height = x->height;
+     if (y->left) ++y->left->refs;
+     if (y->right) ++y->right->refs;
+     --x->refs;
+     return y;
+   }
+
+   // the rotations move links around without adding or dropping any, so the
+   // counts stay right; the nodes involved must be private already
+   static Node *rotateRight(Node *x) {
+     Node *l = x->left;
+     x->left = l->right;
+     l->right = x;
+     fix(x); fix(l);
+     return l;
+   }
+   static Node *rotateLeft(Node *x) {
+     Node *r = x->right;
+     x->right = r->left;
+     r->left = x;
+     fix(x); fix(r);
+     return r;
+   }
+
+   // x is private; restore the AVL condition at x after one side changed by one
+   Node *balance(Node *x) {
+     int b = height(x->left) - height(x->right);
+     if (b > 1) {
+       Node *l = x->left = own(x->left);
+       if (height(l->left) < height(l->right)) {
+         l->right = own(l->right);
+         x->left = rotateLeft(l);
+       }
+       return rotateRight(x);
+     }
+     if (b < -1) {
+       Node *r = x->right = own(x->right);
+       if (height(r->right) < height(r->left)) {
+         r->left = own(r->left);
+         x->right = rotateRight(r);
+       }
+       return rotateLeft(x);
+     }
+     fix(x);
+     return x;
+   }
+
+   Node *findNode(const Key &key) const {
+     Node *x = root;
+     while (x) {
+       if (comp(key, x->value.first)) x = x->left;
+       else if (comp(x->value.first, key)) x = x->right;
+       else return x;
+     }
+     return nullptr;
+   }
+
+   // key must be absent and its path private (see ownPath). AVL insertion
+   // only rotates nodes on that path, so nothing here copies or throws.
+   Node *insertAt(Node *x, const Key &key, Node *hit) {
+     if (!x) return hit;
+     if (comp(key, x->value.first)) x->left = insertAt(x->left, key, hit);
+     else x->right = insertAt(x->right, key, hit);
+     return balance(x);
+   }
+
+   // subtree y without its smallest node, which is handed back in m
+   Node *removeMin(Node *y, Node *&m) {
+     if (!y->left) {
+       Node *r = y->right;
+       y->right = nullptr;
+       m = y;
+       return r;
+     }
+     y->left = removeMin(y->left, m);
+     return balance(y);
+   }
+
+   // key must be present and ownPath<true>(key) done, so the rotations on
+   // the way back up find every node they take already private
+   Node *eraseAt(Node *x, const Key &key) {
+     if (comp(key, x->value.first)) {
+       x->left = eraseAt(x->left, key);
+       return balance(x);
+     }
+     if (comp(x->value.first, key)) {
+       x->right = eraseAt(x->right, key);
+       return balance(x);
+     }
+     // x's links to its children pass to what replaces it
+     Node *l = x->left, *r = x->right, *top;
+     if (!l || !r) {
+       top = l ? l : r;
+     } else {
+       r = removeMin(r, top);
+       top->left = l;
+       top->right = r;
+       top = balance(top);
+     }
+     freeNode(x);
+     return top;
+   }
+
+   // make private, top down, the path to key; with Erase also the rest of
+   // the path to the node that takes key's place, and the nodes beside the
+   // path that a rotation may take: a sibling taller than the path side, and
+   // its inner child when that is the taller one. each copy is linked in as
+   // soon as it is made, so if one throws the tree keeps its elements and
+   // its counts. return the node holding key, or nullptr.
+   template<bool Erase = false>
+   Node *ownPath(const Key &key) {
+     Node **link = &root, *hit = nullptr;
+     while (Node *x = *link) {
+       x = *link = own(x);
+       bool toLeft;
+       if (hit) toLeft = true;
+       else if (comp(key, x->value.first)) toLeft = true;
+       else if (comp(x->value.first, key)) toLeft = false;
+       else if (!Erase || !x->left || !x->right) return x;
+       else { hit = x; toLeft = false; }
+       if (Erase) {
+         Node *&side = toLeft ? x->right : x->left;
+         if (height(side) > height(toLeft ? x->left : x->right)) {
+           Node *s = side = own(side);
+           Node *&inner = toLeft ? s->left : s->right;
+           if (height(inner) > height(toLeft ? s->right : s->left)) inner = own(inner);
+         }
+       }
+       link = toLeft ? &x->left : &x->right;
+     }
+     return hit;
+   }
+
+   // insert a new element built from args for the absent key. the path is
+   // made private and the node built before anything is linked, so if either
+   // throws the map keeps its elements.
+   template<class... Args>
+   Node *add(const Key &key, Args &&... args) {
+     ownPath(key);
+     Node *x = make(nullptr, nullptr, std::forward<Args>(args)...);
+     root = insertAt(root, key, x);
+     ++n;
+     return x;
+   }
+
+  public:
+   /**
+  * bidirectional, read-only iterator. it keeps the path from the root, so a
+  * step costs O(1) amortized without parent links.
+  * throw invalid_iterator when stepping or dereferencing past the ends.
+    */
+   class const_iterator {
+     private:
+      const Node *path[maxHeight];
+      int depth = 0;
+      const persistent_map *owner = nullptr;
+      friend class persistent_map;
+
+      void pushLeft(const Node *x) { for (; x; x = x->left) path[depth++] = x; }
+      void pushRight(const Node *x) { for (; x; x = x->right) path[depth++] = x; }
+      const Node *cur() const { return depth ? path[depth - 1] : nullptr; }
+
+     public:
+      const_iterator() {}
+      const_iterator(const const_iterator &other) : depth(other.depth), owner(other.owner) {
+        for (int i = 0; i < depth; ++i) path[i] = other.path[i];
+      }
+      const_iterator &operator=(const const_iterator &other) {
+        depth = other.depth;
+        owner = other.owner;
+        for (int i = 0; i < depth; ++i) path[i] = other.path[i];
+        return *this;
+      }
+
+      const_iterator &operator++() {
+        if (!depth) throw invalid_iterator();
+        const Node *x = path[depth - 1];
+        if (x->right) {
+          pushLeft(x->right);
+        } else {
+          // climb while we come up from a right child
+          do { x = path[--depth]; } while (depth && path[depth - 1]->right == x);
+        }
+        return *this;
+      }
+      const_iterator &operator--() {
+        if (!owner) throw invalid_iterator();
+        if (!depth) {
+          if (!owner->root) throw invalid_iterator();
+          pushRight(owner->root);
+          return *this;
+        }
+        const Node *x = path[depth - 1];
+        if (x->left) {
+          pushRight(x->left);
+          return *this;
+        }
+        int d = depth;
+        do { x = path[--d]; } while (d && path[d - 1]->left == x);
+        if (!d) throw invalid_iterator();  // already at begin()
+        depth = d;
+        return *this;
+      }
+      const_iterator operator++(int) {
+        const_iterator tmp = *this;
+        ++*this;
+        return tmp;
+      }
+      const_iterator operator--(int) {
+        const_iterator tmp = *this;
+        --*this;
+        return tmp;
+      }
+
+      const value_type &operator*() const {
+        if (!depth) throw invalid_iterator();
+        return path[depth - 1]->value;
+      }
+      const value_type *operator->() const {
+        if (!depth) throw invalid_iterator();
+        return &path[depth - 1]->value;
+      }
+
+      bool operator==(const const_iterator &rhs) const { return owner == rhs.owner && cur() == rhs.cur(); }
+      bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+   };
+   typedef const_iterator iterator;
+
+  private:
+   // the first node not less than key (Upper: greater than key), with its path
+   template<bool Upper>
+   const_iterator bound(const Key &key) const {
+     const_iterator it;
+     it.owner = this;
+     int keep = 0;
+     for (Node *x = root; x;) {
+       it.path[it.depth++] = x;
+       if (Upper ? comp(key, x->value.first) : !comp(x->value.first, key)) {
+         keep = it.depth;
+         x = x->left;
+       } else {
+         x = x->right;
+       }
+     }
+     it.depth = keep;
+     return it;
+   }
+
+  public:
+   persistent_map() {}
+
+   /**
+  * O(1): the copy shares every node with other until one of them is written to.
+    */
+   persistent_map(const persistent_map &other) : root(other.root), n(other.n), comp(other.comp), alloc(other.alloc) {
+     if (root) ++root->refs;
+   }
+
+   persistent_map(persistent_map &&other) : root(other.root), n(other.n), comp(other.comp), alloc(other.alloc) {
+     other.root = nullptr;
+     other.n = 0;
+   }
+
+   persistent_map &operator=(const persistent_map &other) {
+     if (other.root) ++other.root->refs;
+     release(root);
+     root = other.root;
+     n = other.n;
+     comp = other.comp;
+     alloc = other.alloc;
+     return *this;
+   }
+
+   ~persistent_map() { release(root); }
+
+   /**
+  * access the element with this key; on the non-const version the element is
+  *   made private to this map first, so writing through the reference never
+  *   shows up in other copies.
+  * throw index_out_of_bound if the key is absent.
+    */
+   T &at(const Key &key) {
+     if (!findNode(key)) throw index_out_of_bound();
+     return ownPath(key)->value.second;
+   }
+   const T &at(const Key &key) const {
+     Node *x = findNode(key);
+     if (!x) throw index_out_of_bound();
+     return x->value.second;
+   }
+
+   /**
+  * access the element with this key, inserting value_type(key, T()) first if
+  *   it is absent.
+    */
+   T &operator[](const Key &key) {
+     if (findNode(key)) return ownPath(key)->value.second;
+     return add(key, key, T())->value.second;
+   }
+
+   /**
+  * behave like at() throw index_out_of_bound if such key does not exist.
+    */
+   const T &operator[](const Key &key) const { return at(key); }
+
+   const_iterator begin() const {
+     const_iterator it;
+     it.owner = this;
+     it.pushLeft(root);
+     return it;
+   }
+   const_iterator cbegin() const { return begin(); }
+   const_iterator end() const {
+     const_iterator it;
+     it.owner = this;
+     return it;
+   }
+   const_iterator cend() const { return end(); }
+
+   bool empty() const { return n == 0; }
+   size_t size() const { return n; }
+
+   void clear() {
+     release(root);
+     root = nullptr;
+     n = 0;
+   }
+
+   /**
+  * insert value if its key is absent.
+  * the second of the returned pair is true if the insertion happened.
+    */
+   pair<const_iterator, bool> insert(const value_type &value) {
+     if (findNode(value.first)) return pair<const_iterator, bool>(find(value.first), false);
+     add(value.first, value);
+     return pair<const_iterator, bool>(find(value.first), true);
+   }
+
+   /**
+  * insert (key, obj), or assign obj to the mapped value of an existing key.
+  * return true if a new element was inserted.
+    */
+   template<class M>
+   bool insert_or_assign(const Key &key, M &&obj) {
+     if (findNode(key)) {
+       ownPath(key)->value.second = std::forward<M>(obj);
+       return false;
+     }
+     add(key, key, std::forward<M>(obj));
+     return true;
+   }
+
+   /**
+  * erase the element at pos.
+  * throw invalid_iterator if pos is end() or belongs to another map.
+    */
+   void erase(const_iterator pos) {
+     if (pos.owner != this || !pos.depth) throw invalid_iterator();
+     ownPath<true>(pos->first);
+     root = eraseAt(root, pos->first);
+     --n;
+   }
+
+   /**
+  * erase the element with this key; return the number erased (0 or 1).
+    */
+   size_t erase(const Key &key) {
+     if (!findNode(key)) return 0;
+     ownPath<true>(key);
+     root = eraseAt(root, key);
+     --n;
+     return 1;
+   }
+
+   size_t count(const Key &key) const { return findNode(key) ? 1 : 0; }
+
+   /**
+  * the element with this key, or end().
+    */
+   const_iterator find(const Key &key) const {
+     const_iterator it = bound<false>(key);
+     if (it.depth && comp(key, it.path[it.depth - 1]->value.first)) return end();
+     return it;
+   }
+
+   const_iterator lower_bound(const Key &key) const { return bound<false>(key); }
+   const_iterator upper_bound(const Key &key) const { return bound<true>(key); }
+};
+
+}
+
+#endif
@@ -0,0 +1,316 @@
+/**
+ * a map for many writer threads: the key space is cut into ranges, and each
+ * range is an independent sjtu::map behind a mutex of its own, so writers to
+ * different ranges never wait for each other.
+ *
+ * the ranges are fixed at construction by split keys; split_keys() picks
+ * them from a sample of the expected keys, so that every shard gets a
+ * similar share. since shard i only holds keys below those of shard i + 1,
+ * iterating the shards one after another visits every element in key order.
+ *
+ * a batch collects the writes of one thread per shard and applies a shard's
+ * writes under a single lock acquisition, sorted by key, once it holds
+ * enough of them: threads that hit the same shard take its lock once per
+ * batch instead of once per write.
+ *
+ * not part of the OJ submission; map.hpp does not depend on this file.
+ */
+#ifndef SJTU_SHARDED_MAP_HPP
+#define SJTU_SHARDED_MAP_HPP
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "map.hpp"
+
+namespace sjtu {
+
+template<class Key, class T, class Compare = std::less<Key> >
+class sharded_map {
+  public:
+   typedef pair<const Key, T> value_type;
+
+   /**
+  * how a batch write meets an element that is already there: replace the
+  * mapped value (the default), or e.g. add to it.
+    */
+   struct replace {
+     void operator()(T &cur, T &&incoming) const { cur = std::move(incoming); }
+   };
+
+  private:
+   // on cache lines of their own, so that locking one shard does not slow
+   // down the threads working on its neighbours
+   struct alignas(64) Shard {
+     mutable std::mutex lock;
+     map<Key, T, Compare> m;
+   };
+
+   std::vector<Key> bounds;    // shard i holds the keys in [bounds[i - 1], bounds[i])
+   std::vector<Shard> shards;
+   Compare comp = Compare();
+
+   Shard &shardOf(const Key &key) { return shards[shard_of(key)]; }
+   const Shard &shardOf(const Key &key) const { return shards[shard_of(key)]; }
+
+  public:
+   /**
+  * split keys that cut sample into shards ranges of similar size, for the
+  *   constructor. fewer come back when sample has too few distinct keys.
+    */
+   static std::vector<Key> split_keys(std::vector<Key> sample, size_t shards, Compare comp = Compare()) {
+     std::sort(sample.begin(), sample.end(), comp);
+     std::vector<Key> res;
+     for (size_t i = 1; i < shards && !sample.empty(); ++i) {
+       const Key &k = sample[sample.size() * i / shards];
+       if (!res.empty() && !comp(res.back(), k)) continue;
+       res.push_back(k);
+     }
+     return res;
+   }
+
+   /**
+  * one shard per range between the split keys: bounds.size() + 1 shards.
+  * the split keys are sorted and duplicates dropped.
+    */
+   explicit sharded_map(std::vector<Key> split = std::vector<Key>())
+     : bounds(std::move(split)) {
+     std::sort(bounds.begin(), bounds.end(), comp);
+     typename std::vector<Key>::iterator kept = bounds.begin();
+     for (typename std::vector<Key>::iterator it = bounds.begin(); it != bounds.end(); ++it)
+       if (kept == bounds.begin() || comp(*(kept - 1), *it)) *kept++ = std::move(*it);
+     bounds.erase(kept, bounds.end());
+     std::vector<Shard>(bounds.size() + 1).swap(shards);
+   }
+   sharded_map(const sharded_map &) = delete;
+   sharded_map &operator=(const sharded_map &) = delete;
+
+   size_t shard_count() const { return shards.size(); }
+
+   /**
+  * the shard key belongs to.
+    */
+   size_t shard_of(const Key &key) const {
+     return std::upper_bound(bounds.begin(), bounds.end(), key, comp) - bounds.begin();
+   }
+
+   /**
+  * insert value if its key is absent; return whether it was inserted.
+    */
+   bool insert(const value_type &value) {
+     Shard &s = shardOf(value.first);
+     std::lock_guard<std::mutex> hold(s.lock);
+     return s.m.insert(value).second;
+   }
+
+   /**
+  * insert (key, obj), or replace the mapped value of an existing key.
+  * return true if a new element was inserted.
+    */
+   template<class M>
+   bool insert_or_assign(const Key &key, M &&obj) {
+     Shard &s = shardOf(key);
+     std::lock_guard<std::mutex> hold(s.lock);
+     return s.m.insert_or_assign(key, std::forward<M>(obj)).second;
+   }
+
+   /**
+  * fn(m[key]) with the shard of key locked: the operator[] upsert, with the
+  *   mapped value default-constructed first if the key is new. fn must not
+  *   touch this map.
+    */
+   template<class F>
+   void update(const Key &key, F fn) {
+     Shard &s = shardOf(key);
+     std::lock_guard<std::mutex> hold(s.lock);
+     fn(s.m[key]);
+   }
+
+   /**
+  * remove the element with this key; return the number removed (0 or 1).
+    */
+   size_t erase(const Key &key) {
+     Shard &s = shardOf(key);
+     std::lock_guard<std::mutex> hold(s.lock);
+     return s.m.erase(key);
+   }
+
+   /**
+  * find copies the mapped value into out and tells whether the key was there.
+    */
+   bool find(const Key &key, T &out) const {
+     const Shard &s = shardOf(key);
+     std::lock_guard<std::mutex> hold(s.lock);
+     typename map<Key, T, Compare>::const_iterator it = s.m.find(key);
+     if (it == s.m.cend()) return false;
+     out = it->second;
+     return true;
+   }
+   size_t count(const Key &key) const {
+     const Shard &s = shardOf(key);
+     std::lock_guard<std::mutex> hold(s.lock);
+     return s.m.count(key);
+   }
+
+   /**
+  * the number of elements, counted shard by shard; with writers running it
+  *   need not match any single moment.
+    */
+   size_t size() const {
+     size_t res = 0;
+     for (size_t i = 0; i < shards.size(); ++i) {
+       std::lock_guard<std::mutex> hold(shards[i].lock);
+       res += shards[i].m.size();
+     }
+     return res;
+   }
+   bool empty() const { return size() == 0; }
+
+   void clear() {
+     for (size_t i = 0; i < shards.size(); ++i) {
+       std::lock_guard<std::mutex> hold(shards[i].lock);
+       shards[i].m.clear();
+     }
+   }
+
+   /**
+  * fn(element) for every element, in key order, with the shard of the
+  *   element locked; fn may change the mapped value but must not touch this
+  *   map. writers to the shards not being visited keep going.
+    */
+   template<class F>
+   void for_each(F fn) {
+     for (size_t i = 0; i < shards.size(); ++i) {
+       std::lock_guard<std::mutex> hold(shards[i].lock);
+       for (typename map<Key, T, Compare>::iterator it = shards[i].m.begin(); it != shards[i].m.end(); ++it) fn(*it);
+     }
+   }
+
+   /**
+  * iterates all shards in key order, without locking: only while no thread
+  *   writes to the map.
+    */
+   class const_iterator {
+     private:
+      typedef typename map<Key, T, Compare>::const_iterator inner;
+      const sharded_map *owner = nullptr;
+      size_t shard = 0;
+      inner it;
+      friend class sharded_map;
+
+      // move on to the first element at or after (shard, it)
+      void settle() {
+        while (shard < owner->shards.size() && it == owner->shards[shard].m.cend())
+          if (++shard < owner->shards.size()) it = owner->shards[shard].m.cbegin();
+      }
+      const_iterator(const sharded_map *o, size_t s) : owner(o), shard(s) {
+        if (shard < owner->shards.size()) {
+          it = owner->shards[shard].m.cbegin();
+          settle();
+        }
+      }
+
+     public:
+      const_iterator() {}
+
+      const_iterator &operator++() {
+        if (!owner || shard == owner->shards.size()) throw invalid_iterator();
+        ++it;
+        settle();
+        return *this;
+      }
+      const_iterator operator++(int) {
+        const_iterator tmp = *this;
+        ++*this;
+        return tmp;
+      }
+      const value_type &operator*() const {
+        if (!owner || shard == owner->shards.size()) throw invalid_iterator();
+        return *it;
+      }
+      const value_type *operator->() const { return &**this; }
+
+      bool operator==(const const_iterator &rhs) const {
+        return owner == rhs.owner && shard == rhs.shard && (!owner || shard == owner->shards.size() || it == rhs.it);
+      }
+      bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+   };
+
+   const_iterator cbegin() const { return const_iterator(this, 0); }
+   const_iterator cend() const { return const_iterator(this, shards.size()); }
+
+   /**
+  * one thread's write buffer. put() queues a write for the shard of its key,
+  *   and once a shard's queue holds limit writes they are sorted by key and
+  *   applied under one acquisition of that shard's lock. a new key is
+  *   inserted; for a key present, combine(mapped, incoming) decides.
+  * writes become visible at the latest on flush(); those of one batch to one
+  *   key apply in the order they were put. the destructor flushes as well
+  *   but cannot report errors, so call flush() to see them. if applying
+  *   throws, the writes not applied yet stay queued.
+    */
+   template<class Combine = replace>
+   class batch {
+     private:
+      sharded_map &owner;
+      size_t limit;
+      Combine combine;
+      std::vector<std::vector<std::pair<Key, T> > > queues;
+
+      void apply(size_t i) {
+        std::vector<std::pair<Key, T> > &q = queues[i];
+        if (q.empty()) return;
+        const Compare &comp = owner.comp;
+        std::stable_sort(q.begin(), q.end(),
+                         [&comp](const std::pair<Key, T> &a, const std::pair<Key, T> &b) { return comp(a.first, b.first); });
+        Shard &s = owner.shards[i];
+        size_t done = 0;
+        try {
+          std::lock_guard<std::mutex> hold(s.lock);
+          for (; done < q.size(); ++done) {
+            pair<typename map<Key, T, Compare>::iterator, bool> r = s.m.try_emplace(q[done].first, std::move(q[done].second));
+            if (!r.second) combine(r.first->second, std::move(q[done].second));
+          }
+        } catch (...) {
+          q.erase(q.begin(), q.begin() + done);
+          throw;
+        }
+        q.clear();
+      }
+
+     public:
+      explicit batch(sharded_map &owner, size_t limit = 256, Combine combine = Combine())
+        : owner(owner), limit(limit ? limit : 1), combine(combine), queues(owner.shards.size()) {}
+      batch(const batch &) = delete;
+      batch &operator=(const batch &) = delete;
+      ~batch() {
+        try {
+          flush();
+        } catch (...) {
+        }
+      }
+
+      void put(const Key &key, const T &obj) {
+        size_t i = owner.shard_of(key);
+        queues[i].push_back(std::pair<Key, T>(key, obj));
+        if (queues[i].size() >= limit) apply(i);
+      }
+      void put(Key &&key, T &&obj) {
+        size_t i = owner.shard_of(key);
+        queues[i].push_back(std::pair<Key, T>(std::move(key), std::move(obj)));
+        if (queues[i].size() >= limit) apply(i);
+      }
+
+      /**
+    * apply every queued write.
+      */
+      void flush() {
+        for (size_t i = 0; i < queues.size(); ++i) apply(i);
+      }
+   };
+};
+
+}
+
+#endif